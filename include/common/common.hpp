@@ -28,6 +28,7 @@
 #include <cstdlib>
 #include <cstdio>
 #include <ctime>
+#include <cstring>
 #include <assert.h>
 
 #include <sys/time.h>
@@ -43,6 +44,11 @@
 
 #include <chrono>       // high_resolution_clock
 
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <functional>
+
 #include <sdsl/io.hpp>  // serialize and load
 #include <type_traits>  // enable_if_t and is_fundamental
 
@@ -59,13 +65,13 @@
 #define THRBYTES 5 // The number of bytes for the thresholds
 #define SSABYTES 5 // The number of bytes for the thresholds
 
-std::string NowTime();
-void _internal_messageInfo(const std::string message);
-void _internal_messageWarning( const std::string file, const unsigned int line, const std::string message);
-void _internal_messageError( const std::string file, const unsigned int line,const std::string message);
+inline std::string NowTime();
+inline void _internal_messageInfo(const std::string message);
+inline void _internal_messageWarning( const std::string file, const unsigned int line, const std::string message);
+inline void _internal_messageError( const std::string file, const unsigned int line,const std::string message);
 
 
-std::string NowTime()
+inline std::string NowTime()
 {
     struct timeval tv;
     gettimeofday(&tv, 0);
@@ -86,12 +92,12 @@ template<typename T, typename... Args>
 inline std::string _internal_message(T const &first, const Args&... args) { std::stringstream ss; _internal_message_helper(ss,first,args...); return ss.str(); }
 
 
-void _internal_messageInfo(const std::string message)
+inline void _internal_messageInfo(const std::string message)
 {
   std::cout << "[INFO] " << NowTime() << " - " << "Message: " << message << std::endl;
 }
 
-void _internal_messageWarning( const std::string file, const unsigned int line,
+inline void _internal_messageWarning( const std::string file, const unsigned int line,
   const std::string message)
 {
   std::cout << "[WARNING] " << NowTime() << " - "
@@ -100,7 +106,7 @@ void _internal_messageWarning( const std::string file, const unsigned int line,
   << "Message: " << message << std::endl;
 }
 
-void _internal_messageError( const std::string file, const unsigned int line,
+inline void _internal_messageError( const std::string file, const unsigned int line,
   const std::string message)
 {
   std::cerr << "[ERROR] " << NowTime() << " - "
@@ -154,9 +160,23 @@ void map_file(const char *filename, T*& ptr, size_t& length){
         error("invilid file " + std::string(filename));
 
     length = filestat.st_size / sizeof(T);
+    ptr = nullptr;
 
-    if ((ptr = mmap(NULL, filestat.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED)
-        error("mmap() file " + std::string(filename) + " failed");
+    if (length > 0)
+    {
+        void *p = mmap(NULL, filestat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED)
+            error("mmap() file " + std::string(filename) + " failed");
+        ptr = (T *)p;
+    }
+    close(fd);
+}
+
+// Unmaps the file mapped by map_file
+template<typename T>
+void unmap_file(T* ptr, size_t length){
+    if (ptr != nullptr)
+        munmap((void *)ptr, length * sizeof(T));
 }
 
 template<typename T>
@@ -207,7 +227,7 @@ void read_file(const char *filename, std::vector<T>& ptr){
     fclose(fd);
 }
 
-void read_file(const char *filename, std::string &ptr)
+inline void read_file(const char *filename, std::string &ptr)
 {
   struct stat filestat;
   FILE *fd;
@@ -268,6 +288,130 @@ void write_file(const char *filename, std::vector<T> &ptr)
   fclose(fd);
 }
 
+//*********************** Packed integers **************************************
+// The .bwt.len, .ssa, .esa, and .thr_pos files store integers in SSABYTES or
+// THRBYTES bytes each, little endian.
+
+// Unpacks the m integers of bytes bytes each in in to out. All but the last
+// few integers are read with one unaligned 8-byte load and a mask, a loop
+// without branches that the compiler vectorizes.
+template <size_t bytes>
+inline void unpack_integers(const uint8_t *in, const size_t m, uint64_t *out)
+{
+  static_assert(bytes > 0 and bytes <= 8, "The integers are at most 8 bytes");
+  const uint64_t mask = (bytes == 8 ? ~0ULL : (1ULL << (8 * bytes)) - 1);
+  // Integers that can be loaded with 8 bytes without reading past the end
+  const size_t safe = (bytes * m >= 8 ? (bytes * m - 8) / bytes + 1 : 0);
+  size_t i = 0;
+  for (; i < safe; ++i)
+  {
+    uint64_t x;
+    memcpy(&x, in + bytes * i, 8);
+    out[i] = x & mask;
+  }
+  for (; i < m; ++i)
+  {
+    uint64_t x = 0;
+    memcpy(&x, in + bytes * i, bytes);
+    out[i] = x;
+  }
+}
+
+// Reads up to m integers of bytes bytes each from the stream to out, and
+// returns the number of integers read.
+template <size_t bytes>
+inline size_t read_packed(std::istream &in, uint64_t *out, const size_t m)
+{
+  std::vector<uint8_t> buffer(bytes * m);
+  in.read((char *)buffer.data(), buffer.size());
+  const size_t k = in.gcount() / bytes;
+  unpack_integers<bytes>(buffer.data(), k, out);
+  return k;
+}
+
+// Reader of a file of integers of bytes bytes each. The file is read in
+// blocks of integers with pread, so several threads can read it at the same
+// time.
+template <size_t bytes>
+class packed_reader
+{
+public:
+  static constexpr size_t block = 1 << 16; // Integers read at a time
+
+  packed_reader(const std::string &filename_) : filename(filename_)
+  {
+    struct stat filestat;
+
+    if ((fd = open(filename.c_str(), O_RDONLY)) < 0)
+      error("open() file " + filename + " failed");
+
+    if (fstat(fd, &filestat) < 0)
+      error("stat() file " + filename + " failed");
+
+    if (filestat.st_size % bytes != 0)
+      error("invilid file " + filename);
+
+    length = filestat.st_size / bytes;
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  }
+
+  ~packed_reader()
+  {
+    if (fd >= 0)
+      close(fd);
+  }
+
+  packed_reader(const packed_reader &) = delete;
+  packed_reader &operator=(const packed_reader &) = delete;
+
+  // Number of integers in the file
+  inline size_t size() const
+  {
+    return length;
+  }
+
+  // Reads the integers [i..i+m-1] to out
+  void read(const size_t i, const size_t m, uint64_t *out) const
+  {
+    assert(i + m <= length);
+    std::vector<uint8_t> buffer(bytes * m);
+    size_t done = 0;
+    while (done < buffer.size())
+    {
+      ssize_t res = pread(fd, buffer.data() + done, buffer.size() - done, bytes * i + done);
+      if (res <= 0)
+        error("pread() file " + filename + " failed");
+      done += res;
+    }
+    unpack_integers<bytes>(buffer.data(), m, out);
+  }
+
+  // Calls f(i, x) for each integer x in [begin..end-1], in order
+  template <typename function_t>
+  void for_each(const size_t begin, const size_t end, function_t f) const
+  {
+    std::vector<uint64_t> values(block);
+    for (size_t i = begin; i < end; i += block)
+    {
+      const size_t m = std::min(block, end - i);
+      read(i, m, values.data());
+      for (size_t j = 0; j < m; ++j)
+        f(i + j, values[j]);
+    }
+  }
+
+  template <typename function_t>
+  void for_each(function_t f) const
+  {
+    for_each(0, length, f);
+  }
+
+protected:
+  std::string filename;
+  int fd = -1;
+  size_t length = 0;
+};
+
 //*********************** Time resources ***************************************
 
 /*!
@@ -413,6 +557,27 @@ void my_load(std::vector<X> &x, std::istream &in, typename std::enable_if<std::i
   my_load_vector(x, in);
 }
 
+//*********************** Threads **********************************************
+// Runs the tasks on at most threads threads, the calling thread included. Each
+// thread takes the next task that has not been started yet.
+inline void run_tasks(const std::vector<std::function<void()>> &tasks, const size_t threads)
+{
+  const size_t n_threads = std::max((size_t)1, std::min(threads, tasks.size()));
+  std::atomic<size_t> next(0);
+  auto worker = [&]() {
+    size_t i;
+    while ((i = next++) < tasks.size())
+      tasks[i]();
+  };
+
+  std::vector<std::thread> workers;
+  for (size_t t = 1; t < n_threads; ++t)
+    workers.emplace_back(worker);
+  worker();
+  for (auto &w : workers)
+    w.join();
+}
+
 
 
 
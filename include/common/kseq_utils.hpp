@@ -0,0 +1,198 @@
+/* kseq_utils - Helpers to copy and split the reads parsed with kseq
+    Copyright (C) 2026 Massimiliano Rossi
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see http://www.gnu.org/licenses/ .
+*/
+/*!
+   \file kseq_utils.hpp
+   \brief kseq_utils.hpp Helpers to copy and split the reads parsed with kseq.
+   \author Massimiliano Rossi
+   \date 18/10/2026
+*/
+
+#ifndef _KSEQ_UTILS_HH
+#define _KSEQ_UTILS_HH
+
+#include <common.hpp>
+
+#include <zlib.h>
+#include <kseq.h>
+// kseq_t is declared by the r-index headers
+#include <r_index.hpp>
+
+////////////////////////////////////////////////////////////////////////////////
+/// kseq extra
+////////////////////////////////////////////////////////////////////////////////
+
+static inline size_t ks_tell(kseq_t *seq)
+{
+    return gztell(seq->f->f) - seq->f->end + seq->f->begin;
+}
+
+inline void copy_kstring_t(kstring_t &l, kstring_t &r)
+{
+    l.l = r.l;
+    l.m = r.m;
+    l.s = (char *)malloc(l.m);
+    for (size_t i = 0; i < r.m; ++i)
+        l.s[i] = r.s[i];
+}
+
+inline void copy_kseq_t(kseq_t *l, kseq_t *r)
+{
+    copy_kstring_t(l->name, r->name);
+    copy_kstring_t(l->comment, r->comment);
+    copy_kstring_t(l->seq, r->seq);
+    copy_kstring_t(l->qual, r->qual);
+    l->last_char = r->last_char;
+}
+
+// Frees the strings of a copy made with copy_kseq_t
+inline void free_kseq_copy(kseq_t *seq)
+{
+    free(seq->name.s);
+    free(seq->comment.s);
+    free(seq->seq.s);
+    free(seq->qual.s);
+}
+
+inline char complement(const char n)
+{
+    switch (n)
+    {
+    case 'A':
+        return 'T';
+    case 'T':
+        return 'A';
+    case 'G':
+        return 'C';
+    case 'C':
+        return 'G';
+    default:
+        return n;
+    }
+}
+
+// Writes in rev a copy of seq with the reverse complement of its sequence
+inline void reverse_complement(kseq_t *rev, kseq_t *seq)
+{
+    copy_kseq_t(rev, seq);
+
+    for (size_t i = 0; i < seq->seq.l; ++i)
+        rev->seq.s[i] = complement(seq->seq.s[seq->seq.l - i - 1]);
+
+    if (rev->seq.m > rev->seq.l)
+        rev->seq.s[rev->seq.l] = 0;
+}
+
+// Offset of the record that kseq_read is going to read next
+static inline size_t ks_record_start(kseq_t *seq)
+{
+    // After a FASTA record the header character of the next one is consumed
+    return ks_tell(seq) - (seq->last_char != 0 ? 1 : 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Parallel computation
+////////////////////////////////////////////////////////////////////////////////
+
+// This should be done using buffering.
+inline size_t next_start_fastq(gzFile fp)
+{
+    int c;
+    // Special case when we arr at the beginning of the file.
+    if ((gztell(fp) == 0) && ((c = gzgetc(fp)) != EOF) && c == '@')
+        return 0;
+
+    // Strart from the previous character
+    gzseek(fp, -1, SEEK_CUR);
+
+    std::vector<std::pair<int, size_t>> window;
+    // Find the first new line
+    for (size_t i = 0; i < 4; ++i)
+    {
+        while (((c = gzgetc(fp)) != EOF) && (c != (int)'\n'))
+        {
+        }
+        if (c == EOF)
+            return gztell(fp);
+        if ((c = gzgetc(fp)) == EOF)
+            return gztell(fp);
+        window.push_back(std::make_pair(c, gztell(fp) - 1));
+    }
+
+    for (size_t i = 0; i < 2; ++i)
+    {
+        if (window[i].first == '@' && window[i + 2].first == '+')
+            return window[i].second;
+        if (window[i].first == '+' && window[i + 2].first == '@')
+            return window[i + 2].second;
+    }
+
+    return gztell(fp);
+}
+
+// test if the file is gzipped
+static inline bool is_gzipped(std::string filename)
+{
+    FILE *fp = fopen(filename.c_str(), "rb");
+    if (fp == NULL)
+        error("Opening file " + filename);
+    int byte1 = 0, byte2 = 0;
+    fread(&byte1, sizeof(char), 1, fp);
+    fread(&byte2, sizeof(char), 1, fp);
+    fclose(fp);
+    return (byte1 == 0x1f && byte2 == 0x8b);
+}
+
+// Return the length of the file
+// Assumes that the file is not compressed
+static inline size_t get_file_size(std::string filename)
+{
+    if (is_gzipped(filename))
+    {
+        std::cerr << "The input is gzipped!" << std::endl;
+        return -1;
+    }
+    FILE *fp = fopen(filename.c_str(), "r");
+    fseek(fp, 0L, SEEK_END);
+    size_t size = ftell(fp);
+    fclose(fp);
+    return size;
+}
+
+// Returns the offsets of the first records of n_threads blocks of the file,
+// followed by the size of the file.
+inline std::vector<size_t> split_fastq(std::string filename, size_t n_threads)
+{
+    //Precondition: the file is not gzipped
+    // scan file for start positions and execute threads
+    size_t size = get_file_size(filename);
+
+    gzFile fp = gzopen(filename.c_str(), "r");
+    if (fp == Z_NULL)
+    {
+        throw new std::runtime_error("Cannot open input file " + filename);
+    }
+
+    std::vector<size_t> starts(n_threads + 1);
+    for (size_t i = 0; i < n_threads; ++i)
+    {
+        size_t start = (size_t)((size * i) / n_threads);
+        gzseek(fp, start, SEEK_SET);
+        starts[i] = next_start_fastq(fp);
+    }
+    starts[n_threads] = size;
+    gzclose(fp);
+    return starts;
+}
+
+#endif /* end of include guard: _KSEQ_UTILS_HH */
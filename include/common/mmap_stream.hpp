@@ -0,0 +1,130 @@
+/* mmap_stream - Input stream over a memory mapped file
+    Copyright (C) 2026 Massimiliano Rossi
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see http://www.gnu.org/licenses/ .
+*/
+/*!
+   \file mmap_stream.hpp
+   \brief mmap_stream.hpp Input stream over a memory mapped file.
+   \author Massimiliano Rossi
+   \date 18/10/2026
+*/
+
+#ifndef _MMAP_STREAM_HH
+#define _MMAP_STREAM_HH
+
+#include <common.hpp>
+
+#include <fstream>
+#include <streambuf>
+
+// Read-only stream buffer over a memory mapped file. The structures are still
+// deserialized from the stream, but the file is read through the page cache
+// without the copies of the buffered reads.
+class mmap_streambuf : public std::streambuf
+{
+public:
+    mmap_streambuf(const std::string &filename)
+    {
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+            return;
+
+        struct stat st;
+        if (fstat(fd, &st) == 0 and st.st_size > 0)
+        {
+            length = st.st_size;
+            void *ptr = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (ptr != MAP_FAILED)
+            {
+                data = (char *)ptr;
+                madvise(data, length, MADV_SEQUENTIAL);
+                setg(data, data, data + length);
+            }
+        }
+        close(fd);
+    }
+
+    ~mmap_streambuf()
+    {
+        if (data != nullptr)
+            munmap(data, length);
+    }
+
+    mmap_streambuf(const mmap_streambuf &) = delete;
+    mmap_streambuf &operator=(const mmap_streambuf &) = delete;
+
+    inline bool is_open() const
+    {
+        return data != nullptr;
+    }
+
+protected:
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                     std::ios_base::openmode which = std::ios_base::in) override
+    {
+        char *base = (dir == std::ios_base::beg ? eback() : (dir == std::ios_base::cur ? gptr() : egptr()));
+        return seekpos(pos_type(base + off - eback()), which);
+    }
+
+    pos_type seekpos(pos_type pos, std::ios_base::openmode which = std::ios_base::in) override
+    {
+        if (not(which & std::ios_base::in) or pos < 0 or (size_t)pos > length)
+            return pos_type(off_type(-1));
+        setg(eback(), eback() + pos, egptr());
+        return pos;
+    }
+
+    char *data = nullptr;
+    size_t length = 0;
+};
+
+class mmap_istream : public std::istream
+{
+public:
+    mmap_istream(const std::string &filename) : std::istream(nullptr), buf(filename)
+    {
+        rdbuf(&buf);
+        if (not buf.is_open())
+            setstate(std::ios_base::failbit);
+    }
+
+    inline bool is_open() const
+    {
+        return buf.is_open();
+    }
+
+protected:
+    mmap_streambuf buf;
+};
+
+// Loads the structure from the file, either through a memory mapping of the
+// file or with a buffered stream.
+template <typename T>
+void load_file(T &x, const std::string &filename, const bool use_mmap = false)
+{
+    if (use_mmap)
+    {
+        mmap_istream in(filename);
+        if (not in.is_open())
+            error("open() file " + filename + " failed");
+        x.load(in);
+    }
+    else
+    {
+        std::ifstream in(filename);
+        if (not in.is_open())
+            error("open() file " + filename + " failed");
+        x.load(in);
+    }
+}
+
+#endif /* end of include guard: _MMAP_STREAM_HH */
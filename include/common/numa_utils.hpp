@@ -0,0 +1,214 @@
+/* numa_utils - Placement of the index on the NUMA nodes
+    Copyright (C) 2026 Massimiliano Rossi
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see http://www.gnu.org/licenses/ .
+*/
+/*!
+   \file numa_utils.hpp
+   \brief numa_utils.hpp Placement of the index on the NUMA nodes.
+   \author Massimiliano Rossi
+   \date 18/10/2026
+*/
+
+#ifndef _NUMA_UTILS_HH
+#define _NUMA_UTILS_HH
+
+#include <common.hpp>
+
+#include <fstream>
+#include <memory>
+#include <thread>
+#include <functional>
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+
+// The node topology is read from sysfs and the memory policy is set with the
+// set_mempolicy system call, so libnuma is not needed.
+
+enum numa_policy
+{
+    NUMA_NONE = 0,   // Memory and threads placed by the kernel
+    NUMA_INTERLEAVE, // Index pages interleaved over the nodes
+    NUMA_REPLICATE   // One copy of the index per node, workers pinned to their node
+};
+
+inline numa_policy parse_numa_policy(const std::string &s)
+{
+    if (s == "none")
+        return NUMA_NONE;
+    if (s == "interleave")
+        return NUMA_INTERLEAVE;
+    if (s == "replicate")
+        return NUMA_REPLICATE;
+    error("Unknown NUMA policy " + s + ", use none, interleave, or replicate");
+    return NUMA_NONE;
+}
+
+// Parses a sysfs list as "0-3,8,10-11"
+inline std::vector<int> parse_sysfs_list(const std::string &s)
+{
+    std::vector<int> res;
+    std::stringstream ss(s);
+    std::string range;
+    while (std::getline(ss, range, ','))
+    {
+        if (range.empty() or range == "\n")
+            continue;
+        size_t dash = range.find('-');
+        int a = std::stoi(range.substr(0, dash));
+        int b = (dash == std::string::npos ? a : std::stoi(range.substr(dash + 1)));
+        for (int i = a; i <= b; ++i)
+            res.push_back(i);
+    }
+    return res;
+}
+
+typedef struct numa_node_t
+{
+    int id;                // Node number
+    std::vector<int> cpus; // CPUs of the node
+} numa_node_t;
+
+// The online nodes with at least one CPU. Empty if the topology is not
+// available.
+inline std::vector<numa_node_t> numa_nodes()
+{
+    std::vector<numa_node_t> res;
+    std::ifstream online("/sys/devices/system/node/online");
+    std::string line;
+    if (not online.is_open() or not std::getline(online, line))
+        return res;
+
+    for (int id : parse_sysfs_list(line))
+    {
+        std::ifstream in("/sys/devices/system/node/node" + std::to_string(id) + "/cpulist");
+        std::string cpus;
+        if (in.is_open() and std::getline(in, cpus))
+        {
+            numa_node_t node;
+            node.id = id;
+            node.cpus = parse_sysfs_list(cpus);
+            if (not node.cpus.empty())
+                res.push_back(node);
+        }
+    }
+    return res;
+}
+
+// Binds the calling thread to the given CPUs
+inline bool pin_thread(const std::vector<int> &cpus)
+{
+    if (cpus.empty())
+        return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int c : cpus)
+        if (c < CPU_SETSIZE)
+            CPU_SET(c, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &set) == 0;
+}
+
+// Memory policy of the calling thread: interleaved over the given nodes, or
+// the default policy if nodes is empty.
+inline bool set_interleave(const std::vector<numa_node_t> &nodes)
+{
+#ifdef SYS_set_mempolicy
+    const int mpol_default = 0, mpol_interleave = 3;
+    const size_t word = 8 * sizeof(unsigned long);
+    std::vector<unsigned long> mask(1, 0);
+    for (const auto &node : nodes)
+    {
+        if ((size_t)node.id / word >= mask.size())
+            mask.resize(node.id / word + 1, 0);
+        mask[node.id / word] |= 1UL << (node.id % word);
+    }
+    long res;
+    if (nodes.empty())
+        res = syscall(SYS_set_mempolicy, mpol_default, NULL, 0);
+    else
+        res = syscall(SYS_set_mempolicy, mpol_interleave, mask.data(), mask.size() * word + 1);
+    return res == 0;
+#else
+    return false;
+#endif
+}
+
+// The copies of the index used by the workers. With NUMA_REPLICATE each copy
+// is loaded by a thread pinned to its node, so its pages are allocated there
+// on first touch, and worker i runs on node i mod the number of nodes. With
+// NUMA_INTERLEAVE the only copy is loaded with the pages interleaved.
+template <typename T>
+class numa_replicas
+{
+public:
+    numa_replicas(const numa_policy policy_, std::function<T *()> make) : policy(policy_)
+    {
+        std::vector<numa_node_t> all = numa_nodes();
+        if (policy != NUMA_NONE and all.size() < 2)
+        {
+            verbose("Less than two NUMA nodes, ignoring the NUMA policy");
+            policy = NUMA_NONE;
+        }
+
+        if (policy == NUMA_REPLICATE)
+        {
+            nodes = all;
+            replicas.resize(nodes.size());
+            std::vector<std::thread> loaders;
+            for (size_t i = 0; i < nodes.size(); ++i)
+                loaders.emplace_back([&, i]() {
+                    if (not pin_thread(nodes[i].cpus))
+                        warning("Cannot pin the thread to NUMA node ", nodes[i].id);
+                    replicas[i].reset(make());
+                });
+            for (auto &t : loaders)
+                t.join();
+            verbose("Index replicated on", nodes.size(), "NUMA nodes");
+        }
+        else if (policy == NUMA_INTERLEAVE)
+        {
+            if (not set_interleave(all))
+                warning("Cannot interleave the memory over the NUMA nodes");
+            replicas.emplace_back(make());
+            set_interleave({});
+            verbose("Index interleaved on", all.size(), "NUMA nodes");
+        }
+        else
+            replicas.emplace_back(make());
+    }
+
+    // The copy used outside the workers
+    inline T *primary()
+    {
+        return replicas[0].get();
+    }
+
+    inline T *get(const size_t worker)
+    {
+        return replicas[worker % replicas.size()].get();
+    }
+
+    // Binds the calling thread, the worker-th worker, to the node of its copy
+    inline void pin(const size_t worker)
+    {
+        if (policy == NUMA_REPLICATE)
+            pin_thread(nodes[worker % nodes.size()].cpus);
+    }
+
+protected:
+    numa_policy policy;
+    std::vector<numa_node_t> nodes;
+    std::vector<std::unique_ptr<T>> replicas;
+};
+
+#endif /* end of include guard: _NUMA_UTILS_HH */
@@ -22,6 +22,9 @@
 
 #include <common.hpp>
 
+#include <algorithm>
+#include <functional>
+
 #include <sdsl/sd_vector.hpp>
 
 #include <kseq.h>
@@ -54,6 +57,9 @@ public:
 
         while (kseq_read(seq) >= 0)
         {
+            // Empty sequences have no position in the text, as in fasta_to_text
+            if (seq->seq.l == 0)
+                continue;
             u += seq->seq.l;
             names.push_back(std::string(seq->name.s));
             onset.push_back(u);
@@ -62,7 +68,8 @@ public:
         kseq_destroy(seq);
         gzclose(fp);
 
-        sdsl::sd_vector_builder builder(u, onset.size());
+        // onset ends with u, the universe includes it
+        sdsl::sd_vector_builder builder(u + 1, onset.size());
         for (auto idx : onset)
             builder.set(idx);
 
@@ -83,13 +90,15 @@ public:
         assert(onset.size() == names_.size());
         assert(onset[0] == 0);
         assert(onset.back() < l);
-        assert(std::is_sorted(onset.begin(), onset.end()));
+        // The sequences are not empty
+        assert(std::adjacent_find(onset.begin(), onset.end(), std::greater_equal<size_t>()) == onset.end());
 
         u = l;
         names = std::vector<std::string>(names_);
 
 
-        sdsl::sd_vector_builder builder(u, onset.size());
+        // The onsets followed by u, as in the constructor from the file
+        sdsl::sd_vector_builder builder(u + 1, onset.size() + 1);
         for (auto idx : onset)
             builder.set(idx);
         
@@ -100,7 +109,36 @@ public:
         select1 = sdsl::sd_vector<>::select_1_type(&starts);
     }
 
-    
+    /**
+     * @brief Append the sequences of other, whose text follows the text of this
+     *
+     * @param other
+     */
+    void append(const seqidx &other)
+    {
+        if (other.u == 0)
+            return;
+
+        std::vector<size_t> onset;
+        onset.reserve(names.size() + other.names.size());
+        for (size_t i = 0; i < names.size(); ++i)
+            onset.push_back(select1(i + 1));
+        for (size_t i = 0; i < other.names.size(); ++i)
+            onset.push_back(u + other.select1(i + 1));
+
+        u += other.u;
+        names.insert(names.end(), other.names.begin(), other.names.end());
+
+        sdsl::sd_vector_builder builder(u + 1, onset.size() + 1);
+        for (auto idx : onset)
+            builder.set(idx);
+
+        builder.set(u);
+
+        starts = sdsl::sd_vector<>(builder);
+        rank1 = sdsl::sd_vector<>::rank_1_type(&starts);
+        select1 = sdsl::sd_vector<>::select_1_type(&starts);
+    }
 
     /**
      * @brief Return the length of the i-th sequence
@@ -115,6 +153,18 @@ public:
         // return select1(i+1) - select1(i);
     }
 
+    /**
+     * @brief Return the position of the first character of the i-th sequence
+     * 
+     * @param i 
+     * @return size_t 
+     */
+    inline size_t start(const size_t i)
+    {
+        assert(i < names.size());
+        return select1(i+1);
+    }
+
     /**
      * @brief return the name of the sequence pos belongs.
      * 
@@ -139,6 +189,28 @@ public:
         return std::make_pair(names[rank-1],pos - start); // pos+1 becausethe rank counts the 1s before
     }
 
+    /**
+     * @brief return the index of the sequence pos belongs, and its offset.
+     * 
+     * @param pos the position in the set of sequences.
+     * @return std::pair<size_t,size_t> the index of the sequence pos belongs and its offset.
+     */
+    inline std::pair<size_t,size_t> index_id(const size_t pos)
+    {
+        size_t rank = rank1(pos + 1);
+        size_t start = select1(rank);
+        return std::make_pair(rank-1,pos - start); // pos+1 becausethe rank counts the 1s before
+    }
+
+    /**
+     * @brief return the name of the i-th sequence.
+     */
+    inline const std::string &name(const size_t i) const
+    {
+        assert(i < names.size());
+        return names[i];
+    }
+
     /**
      * @brief Check if the substring [pos.pos+len-1] does not span two sequences.
      * 
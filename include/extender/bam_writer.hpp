@@ -0,0 +1,487 @@
+/* bam_writer - Writer of BAM records with multithreaded BGZF compression
+    Copyright (C) 2026 Massimiliano Rossi
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see http://www.gnu.org/licenses/ .
+*/
+/*!
+   \file bam_writer.hpp
+   \brief bam_writer.hpp Writer of BAM records with multithreaded BGZF compression.
+   \author Massimiliano Rossi
+   \date 18/10/2026
+*/
+
+#ifndef _BAM_WRITER_HH
+#define _BAM_WRITER_HH
+
+#include <common.hpp>
+
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include <zlib.h>
+
+#include <sam_writer.hpp>
+
+// The BAM records are written assuming a little-endian host.
+
+////////////////////////////////////////////////////////////////////////////////
+/// BGZF compression
+////////////////////////////////////////////////////////////////////////////////
+
+static const size_t BGZF_BLOCK_SIZE = 0xff00;      // Maximum uncompressed size of a block
+static const size_t BGZF_MAX_BLOCK_SIZE = 0x10000; // Maximum compressed size of a block
+static const size_t BGZF_HEADER_SIZE = 18;
+static const size_t BGZF_FOOTER_SIZE = 8;
+
+// Pool of threads compressing BGZF blocks. Blocks can be submitted by many
+// writers at the same time, each writer waits for its own blocks in order.
+class bgzf_pool
+{
+public:
+    typedef struct job_t
+    {
+        std::vector<uint8_t> in;  // Uncompressed data
+        std::vector<uint8_t> out; // Compressed BGZF block
+        bool done = false;
+    } job_t;
+
+    // With n_threads = 0 blocks are compressed by the thread submitting them.
+    bgzf_pool(const size_t n_threads = 0, const int level_ = Z_DEFAULT_COMPRESSION) : level(level_)
+    {
+        for (size_t i = 0; i < n_threads; ++i)
+            threads.emplace_back(&bgzf_pool::worker, this);
+    }
+
+    ~bgzf_pool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stop = true;
+        }
+        cv_jobs.notify_all();
+        for (auto &t : threads)
+            t.join();
+    }
+
+    inline size_t size() const
+    {
+        return threads.size();
+    }
+
+    void submit(job_t *job)
+    {
+        job->done = false;
+        if (threads.empty())
+        {
+            compress(job, level);
+            job->done = true;
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            jobs.push_back(job);
+        }
+        cv_jobs.notify_one();
+    }
+
+    void wait(job_t *job)
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        cv_done.wait(lock, [job] { return job->done; });
+    }
+
+    // Compress job->in in a single BGZF block in job->out.
+    static void compress(job_t *job, const int level)
+    {
+        assert(job->in.size() <= BGZF_BLOCK_SIZE);
+
+        job->out.resize(BGZF_MAX_BLOCK_SIZE);
+        uint8_t *b = job->out.data();
+
+        size_t c_len = deflate_block(job->in, b + BGZF_HEADER_SIZE, level);
+        if (c_len == 0) // Incompressible data are stored
+            c_len = deflate_block(job->in, b + BGZF_HEADER_SIZE, Z_NO_COMPRESSION);
+        if (c_len == 0)
+            error("BGZF compression failed");
+
+        const size_t block_len = BGZF_HEADER_SIZE + c_len + BGZF_FOOTER_SIZE;
+
+        // gzip header with the BC extra field storing the block size
+        static const uint8_t header[16] = {31, 139, 8, 4, 0, 0, 0, 0, 0, 255, 6, 0, 'B', 'C', 2, 0};
+        memcpy(b, header, 16);
+        put_le(b + 16, block_len - 1, 2);
+
+        uint32_t crc = crc32(crc32(0L, Z_NULL, 0), job->in.data(), job->in.size());
+        put_le(b + block_len - 8, crc, 4);
+        put_le(b + block_len - 4, job->in.size(), 4);
+
+        job->out.resize(block_len);
+    }
+
+    // Write the empty block marking the end of a BGZF file.
+    static void write_eof(FILE *fd)
+    {
+        static const uint8_t eof[28] = {31, 139, 8, 4, 0, 0, 0, 0, 0, 255, 6, 0, 66, 67, 2, 0, 27, 0, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+        if (fwrite(eof, sizeof(uint8_t), 28, fd) != 28)
+            error("fwrite() BGZF EOF block failed");
+    }
+
+protected:
+    void worker()
+    {
+        while (true)
+        {
+            job_t *job = nullptr;
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                cv_jobs.wait(lock, [this] { return stop or not jobs.empty(); });
+                if (jobs.empty())
+                    return;
+                job = jobs.front();
+                jobs.pop_front();
+            }
+
+            compress(job, level);
+
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                job->done = true;
+            }
+            cv_done.notify_all();
+        }
+    }
+
+    // Raw deflate of in into out, returns the compressed length or 0 if it
+    // does not fit in a BGZF block.
+    static size_t deflate_block(const std::vector<uint8_t> &in, uint8_t *out, const int level)
+    {
+        z_stream zs;
+        memset(&zs, 0, sizeof(z_stream));
+        if (deflateInit2(&zs, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+            error("deflateInit2() failed");
+
+        zs.next_in = (Bytef *)in.data();
+        zs.avail_in = in.size();
+        zs.next_out = out;
+        zs.avail_out = BGZF_MAX_BLOCK_SIZE - BGZF_HEADER_SIZE - BGZF_FOOTER_SIZE;
+
+        int ret = deflate(&zs, Z_FINISH);
+        size_t c_len = zs.total_out;
+        deflateEnd(&zs);
+
+        return (ret == Z_STREAM_END ? c_len : 0);
+    }
+
+    static inline void put_le(uint8_t *b, uint64_t v, const size_t n)
+    {
+        for (size_t i = 0; i < n; ++i, v >>= 8)
+            b[i] = (uint8_t)(v & 0xff);
+    }
+
+    int level;
+    bool stop = false;
+
+    std::vector<std::thread> threads;
+    std::deque<job_t *> jobs;
+    std::mutex mtx;
+    std::condition_variable cv_jobs;
+    std::condition_variable cv_done;
+};
+
+// Splits the data in BGZF blocks compressed by the pool and writes them in
+// order. Each writer must be used by a single thread.
+class bgzf_writer
+{
+public:
+    bgzf_writer(FILE *fd_, bgzf_pool *pool_) : fd(fd_),
+                                               pool(pool_),
+                                               max_pending(2 * pool_->size() + 2)
+    {
+        assert(pool != nullptr);
+    }
+
+    ~bgzf_writer()
+    {
+        flush();
+    }
+
+    void write(const uint8_t *data, size_t len)
+    {
+        while (len > 0)
+        {
+            if (not cur)
+                cur = new_job();
+
+            const size_t l = std::min(len, BGZF_BLOCK_SIZE - cur->in.size());
+            cur->in.insert(cur->in.end(), data, data + l);
+            data += l;
+            len -= l;
+
+            if (cur->in.size() == BGZF_BLOCK_SIZE)
+                submit();
+        }
+    }
+
+    // Compress the pending data and write all the blocks in the file.
+    void flush()
+    {
+        if (cur and cur->in.size() > 0)
+            submit();
+        while (not pending.empty())
+            write_front();
+    }
+
+protected:
+    typedef bgzf_pool::job_t job_t;
+
+    std::unique_ptr<job_t> new_job()
+    {
+        if (spare.empty())
+            return std::unique_ptr<job_t>(new job_t());
+
+        std::unique_ptr<job_t> job = std::move(spare.back());
+        spare.pop_back();
+        job->in.clear();
+        return job;
+    }
+
+    void submit()
+    {
+        pool->submit(cur.get());
+        pending.push_back(std::move(cur));
+        while (pending.size() > max_pending)
+            write_front();
+    }
+
+    void write_front()
+    {
+        job_t *job = pending.front().get();
+        pool->wait(job);
+        if (fwrite(job->out.data(), sizeof(uint8_t), job->out.size(), fd) != job->out.size())
+            error("fwrite() BGZF block failed");
+        spare.push_back(std::move(pending.front()));
+        pending.pop_front();
+    }
+
+    FILE *fd;
+    bgzf_pool *pool;
+    const size_t max_pending; // Maximum number of blocks being compressed
+
+    std::unique_ptr<job_t> cur; // Block being filled
+    std::deque<std::unique_ptr<job_t>> pending;
+    std::vector<std::unique_ptr<job_t>> spare;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// BAM writer
+////////////////////////////////////////////////////////////////////////////////
+
+class bam_writer
+{
+public:
+    bam_writer(FILE *fd_, bgzf_pool *pool_) : bgzf(fd_, pool_)
+    {
+        // NtD
+    }
+
+    // Write the BAM header. The reference sequences are taken from the @SQ
+    // lines of the SAM header text.
+    void write_header(const std::string &text)
+    {
+        rec.clear();
+        put("BAM\1", 4);
+        put_32(text.size());
+        put(text.data(), text.size());
+
+        std::vector<std::pair<std::string, size_t>> refs;
+        std::istringstream is(text);
+        std::string line;
+        while (std::getline(is, line))
+        {
+            if (line.compare(0, 3, "@SQ") != 0)
+                continue;
+            std::string name;
+            size_t length = 0;
+            std::istringstream ls(line);
+            std::string field;
+            while (std::getline(ls, field, '\t'))
+            {
+                if (field.compare(0, 3, "SN:") == 0)
+                    name = field.substr(3);
+                else if (field.compare(0, 3, "LN:") == 0)
+                    length = std::stoull(field.substr(3));
+            }
+            refs.push_back(std::make_pair(name, length));
+        }
+
+        put_32(refs.size());
+        for (auto &ref : refs)
+        {
+            put_32(ref.first.size() + 1);
+            put(ref.first.c_str(), ref.first.size() + 1);
+            put_32(ref.second);
+        }
+
+        bgzf.write(rec.data(), rec.size());
+        // The header is kept in its own blocks
+        bgzf.flush();
+    }
+
+    void write(const alignment_t &aln)
+    {
+        const kseq_t *read = aln.read;
+        const bool unmapped = aln.flag & 4;
+        const bool paired = aln.flag & 1;
+        // Unmapped mates are placed at the position of the other mate if any
+        const bool placed = (not unmapped) or (paired and aln.ref_id >= 0);
+
+        const size_t l_seq = (unmapped and not paired ? 0 : read->seq.l);
+        const size_t n_cigar = (unmapped ? 0 : aln.cigar.size());
+        const int32_t ref_id = (placed ? aln.ref_id : -1);
+        const int32_t pos = (placed ? (int32_t)aln.pos : -1);
+
+        rec.clear();
+        put_32(0); // block_size, set at the end
+        put_32(ref_id);
+        put_32(pos);
+        put_8(read->name.l + 1);
+        put_8(unmapped ? (paired ? 0 : 255) : aln.mapq);
+        put_16(reg2bin(pos, pos + (unmapped ? 0 : cigar_ref_len(aln.cigar))));
+        put_16(n_cigar);
+        put_16(aln.flag);
+        put_32(l_seq);
+        put_32(aln.mate_ref_id);
+        put_32(aln.mate_ref_id >= 0 ? (int32_t)aln.mate_pos : -1);
+        put_32(aln.mate_ref_id >= 0 ? (int32_t)aln.tlen : 0);
+        put(read->name.s, read->name.l + 1);
+        put(aln.cigar.data(), n_cigar * sizeof(uint32_t));
+
+        // Sequence, two bases per byte
+        size_t off = rec.size();
+        rec.resize(off + (l_seq + 1) / 2 + l_seq);
+        uint8_t *s = rec.data() + off;
+        for (size_t i = 0; i + 1 < l_seq; i += 2)
+            *s++ = (uint8_t)(seq_nt16_table[(uint8_t)read->seq.s[i]] << 4 | seq_nt16_table[(uint8_t)read->seq.s[i + 1]]);
+        if (l_seq & 1)
+            *s++ = (uint8_t)(seq_nt16_table[(uint8_t)read->seq.s[l_seq - 1]] << 4);
+
+        // Qualities
+        if (l_seq > 0 and has_qual(read))
+        {
+            if (aln.reverse() and not unmapped)
+                std::reverse_copy(read->qual.s, read->qual.s + l_seq, s);
+            else
+                memcpy(s, read->qual.s, l_seq);
+            for (size_t i = 0; i < l_seq; ++i)
+                s[i] -= 33;
+        }
+        else
+            memset(s, 0xff, l_seq);
+
+        if (not unmapped)
+        {
+            put_tag_i("AS", aln.score);
+            put_tag_i("NM", aln.nm);
+            if (aln.score2 > 0)
+                put_tag_i("ZS", aln.score2);
+            if (aln.md.size() > 0)
+            {
+                put("MDZ", 3);
+                put(aln.md.c_str(), aln.md.size() + 1);
+            }
+        }
+
+        const int32_t block_size = rec.size() - 4;
+        memcpy(rec.data(), &block_size, 4);
+
+        bgzf.write(rec.data(), rec.size());
+    }
+
+    void flush()
+    {
+        bgzf.flush();
+    }
+
+protected:
+    // From the SAM specification
+    static uint16_t reg2bin(int32_t beg, int32_t end)
+    {
+        if (end <= beg)
+            end = beg + 1;
+        --end;
+        if (beg >> 14 == end >> 14)
+            return ((1 << 15) - 1) / 7 + (beg >> 14);
+        if (beg >> 17 == end >> 17)
+            return ((1 << 12) - 1) / 7 + (beg >> 17);
+        if (beg >> 20 == end >> 20)
+            return ((1 << 9) - 1) / 7 + (beg >> 20);
+        if (beg >> 23 == end >> 23)
+            return ((1 << 6) - 1) / 7 + (beg >> 23);
+        if (beg >> 26 == end >> 26)
+            return ((1 << 3) - 1) / 7 + (beg >> 26);
+        return 0;
+    }
+
+    inline void put(const void *data, const size_t len)
+    {
+        const uint8_t *d = (const uint8_t *)data;
+        rec.insert(rec.end(), d, d + len);
+    }
+
+    inline void put_8(const uint8_t v)
+    {
+        rec.push_back(v);
+    }
+
+    inline void put_16(const uint16_t v)
+    {
+        put(&v, 2);
+    }
+
+    inline void put_32(const int32_t v)
+    {
+        put(&v, 4);
+    }
+
+    inline void put_tag_i(const char *tag, const int32_t v)
+    {
+        put(tag, 2);
+        put_8('i');
+        put_32(v);
+    }
+
+    bgzf_writer bgzf;
+    std::vector<uint8_t> rec; // Record being built
+
+    // "=ACMGRSVTWYHKDBN" encoding of the bases
+    const uint8_t seq_nt16_table[256] = {
+        15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+        15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+        15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+        1, 2, 4, 8, 15, 15, 15, 15, 15, 15, 15, 15, 15, 0, 15, 15,
+        15, 1, 14, 2, 13, 15, 15, 4, 11, 15, 15, 12, 15, 3, 15, 15,
+        15, 15, 5, 6, 8, 15, 7, 9, 15, 10, 15, 15, 15, 15, 15, 15,
+        15, 1, 14, 2, 13, 15, 15, 4, 11, 15, 15, 12, 15, 3, 15, 15,
+        15, 15, 5, 6, 8, 15, 7, 9, 15, 10, 15, 15, 15, 15, 15, 15,
+        15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+        15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+        15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+        15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+        15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+        15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+        15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+        15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15};
+};
+
+#endif /* end of include guard: _BAM_WRITER_HH */
@@ -26,35 +26,14 @@ extern "C"{
 }
 
 #include <common.hpp>
-#include <kseq.h>
-#include <zlib.h>
+#include <kseq_utils.hpp>
+#include <numa_utils.hpp>
 
-////////////////////////////////////////////////////////////////////////////////
-/// kseq extra
-////////////////////////////////////////////////////////////////////////////////
-
-static inline size_t ks_tell(kseq_t *seq)
-{
-    return gztell(seq->f->f) - seq->f->end + seq->f->begin;
-}
-
-void copy_kstring_t(kstring_t &l, kstring_t &r)
-{
-    l.l = r.l;
-    l.m = r.m;
-    l.s = (char *)malloc(l.m);
-    for (size_t i = 0; i < r.m; ++i)
-        l.s[i] = r.s[i];
-}
-void copy_kseq_t(kseq_t *l, kseq_t *r)
-{
-    copy_kstring_t(l->name, r->name);
-    copy_kstring_t(l->comment, r->comment);
-    copy_kstring_t(l->seq, r->seq);
-    copy_kstring_t(l->qual, r->qual);
-    l->last_char = r->last_char;
-}
-////////////////////////////////////////////////////////////////////////////////
+#include <ref_cache.hpp>
+#include <sam_writer.hpp>
+#include <bam_writer.hpp>
+#include <paired_end.hpp>
+#include <extend_stats.hpp>
 
 ////////////////////////////////////////////////////////////////////////////////
 /// xerror extra (conditions)
@@ -122,110 +101,87 @@ int xpthread_cond_signal(pthread_cond_t *cond, int linea, const char *file)
 /// Parallel computation
 ////////////////////////////////////////////////////////////////////////////////
 
-// This should be done using buffering.
-size_t next_start_fastq(gzFile fp)
+// Returns, for each offset in starts, the number of records of the file that
+// begin before it. starts must be sorted.
+inline std::vector<size_t> count_records(std::string filename, const std::vector<size_t> &starts)
 {
-    int c;
-    // Special case when we arr at the beginning of the file.
-    if ((gztell(fp) == 0) && ((c = gzgetc(fp)) != EOF) && c == '@')
-        return 0;
-
-    // Strart from the previous character
-    gzseek(fp, -1, SEEK_CUR);
-
-    std::vector<std::pair<int, size_t>> window;
-    // Find the first new line
-    for (size_t i = 0; i < 4; ++i)
-    {
-        while (((c = gzgetc(fp)) != EOF) && (c != (int)'\n'))
-        {
-        }
-        if (c == EOF)
-            return gztell(fp);
-        if ((c = gzgetc(fp)) == EOF)
-            return gztell(fp);
-        window.push_back(std::make_pair(c, gztell(fp) - 1));
-    }
+    gzFile fp = gzopen(filename.c_str(), "r");
+    if (fp == Z_NULL)
+        error("open() file " + filename + " failed");
 
-    for (size_t i = 0; i < 2; ++i)
+    std::vector<size_t> counts(starts.size());
+    kseq_t *seq = kseq_init(fp);
+    size_t i = 0, j = 0;
+    while (true)
     {
-        if (window[i].first == '@' && window[i + 2].first == '+')
-            return window[i].second;
-        if (window[i].first == '+' && window[i + 2].first == '@')
-            return window[i + 2].second;
+        const size_t off = ks_record_start(seq);
+        while (j < starts.size() and starts[j] <= off)
+            counts[j++] = i;
+        if (kseq_read(seq) < 0)
+            break;
+        ++i;
     }
+    while (j < starts.size())
+        counts[j++] = i;
 
-    return gztell(fp);
-}
-
-// test if the file is gzipped
-static inline bool is_gzipped(std::string filename)
-{
-    FILE *fp = fopen(filename.c_str(), "rb");
-    if (fp == NULL)
-        error("Opening file " + filename);
-    int byte1 = 0, byte2 = 0;
-    fread(&byte1, sizeof(char), 1, fp);
-    fread(&byte2, sizeof(char), 1, fp);
-    fclose(fp);
-    return (byte1 == 0x1f && byte2 == 0x8b);
-}
-
-// Return the length of the file
-// Assumes that the file is not compressed
-static inline size_t get_file_size(std::string filename)
-{
-    if (is_gzipped(filename))
-    {
-        std::cerr << "The input is gzipped!" << std::endl;
-        return -1;
-    }
-    FILE *fp = fopen(filename.c_str(), "r");
-    fseek(fp, 0L, SEEK_END);
-    size_t size = ftell(fp);
-    fclose(fp);
-    return size;
+    kseq_destroy(seq);
+    gzclose(fp);
+    return counts;
 }
 
-std::vector<size_t> split_fastq(std::string filename, size_t n_threads)
+// Returns the offsets of the records of the file with the given indexes, or
+// the end of the file for indexes past the last record. idxs must be sorted.
+inline std::vector<size_t> record_offsets(std::string filename, const std::vector<size_t> &idxs)
 {
-    //Precondition: the file is not gzipped
-    // scan file for start positions and execute threads
-    size_t size = get_file_size(filename);
-
     gzFile fp = gzopen(filename.c_str(), "r");
     if (fp == Z_NULL)
-    {
-        throw new std::runtime_error("Cannot open input file " + filename);
-    }
+        error("open() file " + filename + " failed");
 
-    std::vector<size_t> starts(n_threads + 1);
-    for (int i = 0; i < n_threads; ++i)
+    std::vector<size_t> offsets(idxs.size());
+    kseq_t *seq = kseq_init(fp);
+    size_t i = 0, j = 0, off = 0;
+    while (true)
     {
-        size_t start = (size_t)((size * i) / n_threads);
-        gzseek(fp, start, SEEK_SET);
-        starts[i] = next_start_fastq(fp);
+        off = ks_record_start(seq);
+        while (j < idxs.size() and idxs[j] == i)
+            offsets[j++] = off;
+        if (kseq_read(seq) < 0)
+            break;
+        ++i;
     }
-    starts[n_threads] = size;
+    while (j < idxs.size())
+        offsets[j++] = ks_tell(seq);
+
+    kseq_destroy(seq);
     gzclose(fp);
-    return starts;
+    return offsets;
 }
 
-inline char complement(const char n)
+// Splits paired reads in n_threads blocks holding the same pairs. If
+// mates_filename is empty the mates are interleaved in filename.
+// Returns the starting offsets of the blocks in the two files, and writes in
+// first_pairs, if not null, the index of the first pair of each block.
+inline std::pair<std::vector<size_t>, std::vector<size_t>> split_paired_fastq(std::string filename, std::string mates_filename, size_t n_threads, std::vector<size_t> *first_pairs = nullptr)
 {
-    switch (n)
+    std::vector<size_t> starts = split_fastq(filename, n_threads);
+    std::vector<size_t> counts = count_records(filename, starts);
+
+    if (mates_filename == "")
     {
-    case 'A':
-        return 'T';
-    case 'T':
-        return 'A';
-    case 'G':
-        return 'C';
-    case 'C':
-        return 'G';
-    default:
-        return n;
+        // Do not separate the two mates of a pair
+        for (auto &c : counts)
+            c += (c & 1);
+        starts = record_offsets(filename, counts);
+        if (first_pairs != nullptr)
+            for (auto c : counts)
+                first_pairs->push_back(c / 2);
+        return std::make_pair(starts, starts);
     }
+
+    std::vector<size_t> mates_starts = record_offsets(mates_filename, counts);
+    if (first_pairs != nullptr)
+        *first_pairs = counts;
+    return std::make_pair(starts, mates_starts);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -270,6 +226,187 @@ void append_file(const std::string filename, FILE *fp){
 
 ////////////////////////////////////////////////////////////////////////////////
 
+////////////////////////////////////////////////////////////////////////////////
+/// Extend reads
+////////////////////////////////////////////////////////////////////////////////
+
+// Extends the reads of seq, and their reverse complement, until the end of the
+// file or the offset end, writing the alignments in out.
+template <typename extender_t, typename writer_t>
+void extend_reads(extender_t *extender, kseq_t *seq, const size_t end, writer_t *out, ref_cache *cache, size_t &n_reads, size_t &n_extended_reads)
+{
+    kseq_t rev;
+    int l;
+
+    while ((ks_tell(seq) < end) && ((l = kseq_read(seq)) >= 0))
+    {
+
+        bool fwd_extend = extender->extend(seq, out, 0, cache);
+
+        reverse_complement(&rev, seq);
+
+        bool rev_extend = extender->extend(&rev, out, 1, cache);
+
+        if (fwd_extend or rev_extend)
+            n_extended_reads++;
+        n_reads++;
+        stats_read(fwd_extend or rev_extend);
+
+        free_kseq_copy(&rev);
+    }
+}
+
+// Removes the /1 and /2 suffixes from the name of a mate
+static inline void trim_mate_suffix(kstring_t &name)
+{
+    if (name.l > 2 and name.s[name.l - 2] == '/' and (name.s[name.l - 1] == '1' or name.s[name.l - 1] == '2'))
+        name.s[name.l -= 2] = 0;
+}
+
+// Reads the next pair in copies of the two mates. If seq2 is null the mates
+// are interleaved in seq1.
+inline bool read_pair(kseq_t *seq1, kseq_t *seq2, kseq_t *r1, kseq_t *r2)
+{
+    if (kseq_read(seq1) < 0)
+        return false;
+    copy_kseq_t(r1, seq1);
+
+    kseq_t *mate = (seq2 == nullptr ? seq1 : seq2);
+    if (kseq_read(mate) < 0)
+        error("The mate of read " + std::string(r1->name.s) + " is missing");
+    copy_kseq_t(r2, mate);
+
+    trim_mate_suffix(r1->name);
+    trim_mate_suffix(r2->name);
+    return true;
+}
+
+// Extends the pairs of reads of seq1 and seq2 until the end of the file or the
+// offset end of seq1, writing the alignments in out. pair_id is the index of
+// the first pair; the pairs in pilot are written with their alignments.
+template <typename extender_t, typename writer_t>
+void extend_pairs(extender_t *extender, kseq_t *seq1, kseq_t *seq2, const size_t end, writer_t *out, ref_cache *cache, const insert_size_t &insert, const std::vector<pilot_pair_t> &pilot, size_t pair_id, size_t &n_reads, size_t &n_extended_reads)
+{
+    kseq_t r1, r2, r1_rev, r2_rev;
+
+    while ((ks_tell(seq1) < end) && read_pair(seq1, seq2, &r1, &r2))
+    {
+        reverse_complement(&r1_rev, &r1);
+        reverse_complement(&r2_rev, &r2);
+
+        // Number of aligned mates
+        size_t extended;
+        if (pair_id < pilot.size())
+        {
+            pilot_pair_t p = pilot[pair_id];
+            // The alignments point to the strand of the read they align
+            p.a1.read = (p.a1.reverse() ? &r1_rev : &r1);
+            p.a2.read = (p.a2.reverse() ? &r2_rev : &r2);
+            extended = extender->write_pair(&r1, &r1_rev, &r2, &r2_rev, p.a1, p.m1, p.a2, p.m2, out, insert, cache);
+        }
+        else
+            extended = extender->extend_pair(&r1, &r1_rev, &r2, &r2_rev, out, insert, cache);
+        ++pair_id;
+        n_extended_reads += extended;
+        n_reads += 2;
+        stats_read(extended > 0);
+        stats_read(extended > 1);
+
+        free_kseq_copy(&r1);
+        free_kseq_copy(&r2);
+        free_kseq_copy(&r1_rev);
+        free_kseq_copy(&r2_rev);
+    }
+}
+
+// Estimates the insert size aligning the first INSERT_PILOT_PAIRS pairs, whose
+// alignments are stored in pilot.
+template <typename extender_t>
+insert_size_t estimate_insert_size(extender_t *extender, std::string pattern_filename, std::string mates_filename, std::vector<pilot_pair_t> &pilot)
+{
+    verbose("Estimating the insert size");
+
+    gzFile fp1 = gzopen(pattern_filename.c_str(), "r");
+    if (fp1 == Z_NULL)
+        error("open() file " + pattern_filename + " failed");
+    gzFile fp2 = Z_NULL;
+    if (mates_filename != "" and (fp2 = gzopen(mates_filename.c_str(), "r")) == Z_NULL)
+        error("open() file " + mates_filename + " failed");
+
+    kseq_t *seq1 = kseq_init(fp1);
+    kseq_t *seq2 = (fp2 == Z_NULL ? nullptr : kseq_init(fp2));
+
+    ref_cache cache;
+    std::vector<size_t> obs;
+    kseq_t r1, r2, r1_rev, r2_rev;
+    for (size_t i = 0; i < INSERT_PILOT_PAIRS and read_pair(seq1, seq2, &r1, &r2); ++i)
+    {
+        reverse_complement(&r1_rev, &r1);
+        reverse_complement(&r2_rev, &r2);
+
+        pilot_pair_t p;
+        p.m1 = extender->align_best(&r1, &r1_rev, p.a1, &cache);
+        p.m2 = extender->align_best(&r2, &r2_rev, p.a2, &cache);
+        if (p.m1 and p.m2 and is_fr(p.a1, p.a2))
+            obs.push_back(template_len(p.a1, p.a2));
+        pilot.push_back(p);
+
+        free_kseq_copy(&r1);
+        free_kseq_copy(&r2);
+        free_kseq_copy(&r1_rev);
+        free_kseq_copy(&r2_rev);
+    }
+
+    kseq_destroy(seq1);
+    gzclose(fp1);
+    if (seq2 != nullptr)
+    {
+        kseq_destroy(seq2);
+        gzclose(fp2);
+    }
+
+    return estimate_insert_size(obs);
+}
+
+// Extends single reads if insert is null, and pairs of reads otherwise.
+template <typename extender_t, typename writer_t>
+void extend_all(extender_t *extender, kseq_t *seq, kseq_t *mates, const size_t end, writer_t *out, ref_cache *cache, const insert_size_t *insert, const std::vector<pilot_pair_t> &pilot, const size_t first_pair, size_t &n_reads, size_t &n_extended_reads)
+{
+    if (insert != nullptr)
+        extend_pairs(extender, seq, mates, end, out, cache, *insert, pilot, first_pair, n_reads, n_extended_reads);
+    else
+        extend_reads(extender, seq, end, out, cache, n_reads, n_extended_reads);
+}
+
+// Opens the file with the second mates, if any, and positions it at start
+static inline kseq_t *open_mates(std::string mates_filename, size_t start, gzFile &fp)
+{
+    fp = Z_NULL;
+    if (mates_filename == "")
+        return nullptr;
+
+    if ((fp = gzopen(mates_filename.c_str(), "r")) == Z_NULL)
+        error("open() file " + mates_filename + " failed");
+    gzseek(fp, start, SEEK_SET);
+    return kseq_init(fp);
+}
+
+static inline void close_mates(kseq_t *mates, gzFile fp)
+{
+    if (mates == nullptr)
+        return;
+    kseq_destroy(mates);
+    gzclose(fp);
+}
+
+// Returns the extension of the output file
+static inline std::string out_ext(const bool bam)
+{
+    return (bam ? ".bam" : ".sam");
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
 ////////////////////////////////////////////////////////////////////////////////
 /// Multithreads workers
 ////////////////////////////////////////////////////////////////////////////////
@@ -290,9 +427,20 @@ struct mt_param_t
     size_t start;
     size_t end;
     size_t wk_id;
+    bool bam;
+    bgzf_pool *pool;
+    std::string mates_filename;   // Second mates, empty if interleaved
+    size_t mates_start;
+    const insert_size_t *insert;  // Null for single-end reads
+    const std::vector<pilot_pair_t> *pilot; // Pairs aligned to estimate the insert size
+    size_t first_pair;            // Index of the first pair of the block
+    stats_reporter *reporter;
+    numa_replicas<extender_t> *replicas; // Null if the workers are not pinned
     // Return values
     size_t n_reads;
     size_t n_extended_reads;
+    size_t n_cache_hits;
+    size_t n_cache_misses;
 };
 
 template <typename extender_t>
@@ -313,39 +461,37 @@ void *mt_extend_worker(void *param)
 
     gzseek(fp, p->start, SEEK_SET);
 
-    kseq_t rev;
-    int l;
+    if (p->replicas != nullptr)
+        p->replicas->pin(p->wk_id);
+
+    ref_cache cache;
+    thread_stats() = p->reporter->add();
 
     kseq_t *seq = kseq_init(fp);
-    while ((ks_tell(seq) < p->end) && ((l = kseq_read(seq)) >= 0))
+    gzFile mates_fp;
+    kseq_t *mates = (p->insert != nullptr ? open_mates(p->mates_filename, p->mates_start, mates_fp) : nullptr);
+    if (p->bam)
     {
-
-        bool fwd_extend = p->extender->extend(seq, sam_fd, 0);
-
-        //copy seq
-        copy_kseq_t(&rev, seq);
-
-        for (size_t i = 0; i < seq->seq.l; ++i)
-            rev.seq.s[i] = complement(seq->seq.s[seq->seq.l - i - 1]);
-
-        if (rev.seq.m > rev.seq.l)
-            rev.seq.s[rev.seq.l] = 0;
-
-        bool rev_extend = p->extender->extend(&rev, sam_fd, 1);
-
-        if (fwd_extend or rev_extend)
-            n_extended_reads++;
-        n_reads++;
-
-        free(rev.name.s);
-        free(rev.comment.s);
-        free(rev.seq.s);
-        free(rev.qual.s);
+        // The BGZF blocks of the temporary files are concatenated as they are
+        bam_writer bam(sam_fd, p->pool);
+        extend_all(p->extender, seq, mates, p->end, &bam, &cache, p->insert, *p->pilot, p->first_pair, n_reads, n_extended_reads);
+        bam.flush();
+    }
+    else
+    {
+        sam_writer sam(sam_fd);
+        extend_all(p->extender, seq, mates, p->end, &sam, &cache, p->insert, *p->pilot, p->first_pair, n_reads, n_extended_reads);
+        sam.flush();
     }
+    close_mates(mates, mates_fp);
+    thread_stats() = nullptr;
 
     verbose("Number of extended reads block ", p->wk_id, " : ", n_extended_reads, "/", n_reads);
+    verbose("Reference cache block ", p->wk_id, " : ", cache.hits(), " hits, ", cache.misses(), " misses");
     p->n_reads = n_reads;
     p->n_extended_reads = n_extended_reads;
+    p->n_cache_hits = cache.hits();
+    p->n_cache_misses = cache.misses();
     kseq_destroy(seq);
     gzclose(fp);
     fclose(sam_fd);
@@ -362,15 +508,29 @@ void *mt_extend_worker(void *param)
 }
 
 template <typename extender_t>
-size_t mt_extend(extender_t *extender, std::string pattern_filename, std::string sam_filename, size_t n_threads, size_t k)
+size_t mt_extend(extender_t *extender, std::string pattern_filename, std::string sam_filename, size_t n_threads, size_t k, bool bam = false, size_t bgzf_threads = 0, bool paired = false, std::string mates_filename = "", size_t stats_period = 0, numa_replicas<extender_t> *replicas = nullptr)
 {
+    bgzf_pool pool(bam ? bgzf_threads : 0);
+
+    insert_size_t insert;
+    std::vector<pilot_pair_t> pilot;
+    std::vector<size_t> starts, mates_starts, first_pairs;
+    if (paired)
+    {
+        insert = estimate_insert_size(extender, pattern_filename, mates_filename, pilot);
+        std::tie(starts, mates_starts) = split_paired_fastq(pattern_filename, mates_filename, k * n_threads, &first_pairs);
+    }
+    else
+        starts = split_fastq(pattern_filename, k * n_threads);
+
     xpthread_mutex_init(&mutex_reads_dispatcher, NULL, __LINE__, __FILE__);
     xpthread_cond_init(&cond_reads_dispatcher, NULL, __LINE__, __FILE__);
 
+    stats_reporter reporter(stats_period);
+
     // active_threads = std::vector<bool>(n_threads, false);
     pthread_t t[k * n_threads] = {0};
     mt_param_t<extender_t> params[k * n_threads];
-    std::vector<size_t> starts = split_fastq(pattern_filename, k * n_threads);
     for (size_t i = 0; i < k * n_threads; ++i)
     {
         // Get the number of active threads
@@ -380,12 +540,21 @@ size_t mt_extend(extender_t *extender, std::string pattern_filename, std::string
                 xpthread_cond_wait(&cond_reads_dispatcher, &mutex_reads_dispatcher, __LINE__, __FILE__);
             assert(n_active_threads < n_threads);
             // Create a new thread
-            params[i].extender = extender;
+            params[i].extender = (replicas != nullptr ? replicas->get(i) : extender);
             params[i].pattern_filename = pattern_filename;
-            params[i].sam_filename = sam_filename + "_" + std::to_string(i) + ".sam";
+            params[i].sam_filename = sam_filename + "_" + std::to_string(i) + out_ext(bam);
             params[i].start = starts[i];
             params[i].end = starts[i + 1];
             params[i].wk_id = i;
+            params[i].bam = bam;
+            params[i].pool = &pool;
+            params[i].mates_filename = mates_filename;
+            params[i].mates_start = (paired ? mates_starts[i] : 0);
+            params[i].insert = (paired ? &insert : nullptr);
+            params[i].pilot = &pilot;
+            params[i].first_pair = (paired ? first_pairs[i] : 0);
+            params[i].reporter = &reporter;
+            params[i].replicas = replicas;
             xpthread_create(&t[i], NULL, &mt_extend_worker<extender_t>, &params[i], __LINE__, __FILE__);
             // Update the number of active threads
             ++n_active_threads;
@@ -395,36 +564,52 @@ size_t mt_extend(extender_t *extender, std::string pattern_filename, std::string
 
     size_t tot_reads = 0;
     size_t tot_extended_reads = 0;
+    size_t tot_cache_hits = 0;
+    size_t tot_cache_misses = 0;
 
     for (size_t i = 0; i < k * n_threads; ++i)
     {
         xpthread_join(t[i], NULL, __LINE__, __FILE__);
     }
+    reporter.stop();
 
     // sleep(5);
-    verbose("Merging temporary SAM files");
+    verbose("Merging temporary ", (bam ? "BAM" : "SAM"), " files");
 
     FILE *fd;
 
-    if ((fd = fopen(std::string(sam_filename + ".sam").c_str(), "w")) == nullptr)
-        error("open() file " + std::string(sam_filename + ".sam") + " failed");
+    if ((fd = fopen(std::string(sam_filename + out_ext(bam)).c_str(), "w")) == nullptr)
+        error("open() file " + std::string(sam_filename + out_ext(bam)) + " failed");
 
-    fprintf(fd, "%s", extender->to_sam().c_str());
+    if (bam)
+    {
+        bam_writer header(fd, &pool);
+        header.write_header(extender->to_sam());
+    }
+    else
+        fprintf(fd, "%s", extender->to_sam().c_str());
 
     for (size_t i = 0; i < k * n_threads; ++i)
     {
         tot_reads += params[i].n_reads;
         tot_extended_reads += params[i].n_extended_reads;
+        tot_cache_hits += params[i].n_cache_hits;
+        tot_cache_misses += params[i].n_cache_misses;
 
         append_file(params[i].sam_filename, fd);
         if (std::remove(params[i].sam_filename.c_str()) != 0)
             error("remove() file " + params[i].sam_filename + " failed");
     }
-    
+
+    if (bam)
+        bgzf_pool::write_eof(fd);
+    fclose(fd);
+
     xpthread_mutex_destroy(&mutex_reads_dispatcher, __LINE__, __FILE__);
     xpthread_cond_destroy(&cond_reads_dispatcher, __LINE__, __FILE__);
 
     verbose("Number of extended reads: ", tot_extended_reads, "/", tot_reads);
+    verbose("Reference cache: ", tot_cache_hits, " hits, ", tot_cache_misses, " misses");
     return tot_extended_reads;
 }
 
@@ -432,50 +617,52 @@ size_t mt_extend(extender_t *extender, std::string pattern_filename, std::string
 /// Single Thread
 ////////////////////////////////////////////////////////////////////////////////
 template <typename extender_t>
-size_t st_extend(extender_t *extender, std::string pattern_filename, std::string sam_filename)
+size_t st_extend(extender_t *extender, std::string pattern_filename, std::string sam_filename, bool bam = false, size_t bgzf_threads = 0, bool paired = false, std::string mates_filename = "", size_t stats_period = 0)
 {
     size_t n_reads = 0;
     size_t n_extended_reads = 0;
-    kseq_t rev;
-    int l;
     FILE *sam_fd;
 
-    sam_filename += ".sam";
+    sam_filename += out_ext(bam);
 
     if ((sam_fd = fopen(sam_filename.c_str(), "w")) == nullptr)
         error("open() file " + sam_filename + " failed");
 
-    fprintf(sam_fd, "%s", extender->to_sam().c_str());
+    insert_size_t insert;
+    std::vector<pilot_pair_t> pilot;
+    if (paired)
+        insert = estimate_insert_size(extender, pattern_filename, mates_filename, pilot);
+
+    ref_cache cache;
+    stats_reporter reporter(stats_period);
+    thread_stats() = reporter.add();
 
     gzFile fp = gzopen(pattern_filename.c_str(), "r");
     kseq_t *seq = kseq_init(fp);
-    while ((l = kseq_read(seq)) >= 0)
+    gzFile mates_fp;
+    kseq_t *mates = (paired ? open_mates(mates_filename, 0, mates_fp) : nullptr);
+    if (bam)
     {
-
-        bool fwd_extend = extender->extend(seq, sam_fd, 0);
-
-        //copy seq
-        copy_kseq_t(&rev, seq);
-
-        for (size_t i = 0; i < seq->seq.l; ++i)
-            rev.seq.s[i] = complement(seq->seq.s[seq->seq.l - i - 1]);
-
-        if (rev.seq.m > rev.seq.l)
-            rev.seq.s[rev.seq.l] = 0;
-
-        bool rev_extend = extender->extend(&rev, sam_fd, 1);
-
-        if (fwd_extend or rev_extend)
-            n_extended_reads++;
-        n_reads++;
-
-        free(rev.name.s);
-        free(rev.comment.s);
-        free(rev.seq.s);
-        free(rev.qual.s);
+        bgzf_pool pool(bgzf_threads);
+        bam_writer out(sam_fd, &pool);
+        out.write_header(extender->to_sam());
+        extend_all(extender, seq, mates, (size_t)-1, &out, &cache, (paired ? &insert : nullptr), pilot, 0, n_reads, n_extended_reads);
+        out.flush();
+        bgzf_pool::write_eof(sam_fd);
+    }
+    else
+    {
+        fprintf(sam_fd, "%s", extender->to_sam().c_str());
+        sam_writer out(sam_fd);
+        extend_all(extender, seq, mates, (size_t)-1, &out, &cache, (paired ? &insert : nullptr), pilot, 0, n_reads, n_extended_reads);
+        out.flush();
     }
+    close_mates(mates, mates_fp);
+    thread_stats() = nullptr;
+    reporter.stop();
 
     verbose("Number of extended reads: ", n_extended_reads, "/", n_reads);
+    verbose("Reference cache: ", cache.hits(), " hits, ", cache.misses(), " misses");
     kseq_destroy(seq);
     gzclose(fp);
     fclose(sam_fd);
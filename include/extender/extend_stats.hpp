@@ -0,0 +1,309 @@
+/* extend_stats - Per-thread profiling counters of the extension of the reads
+    Copyright (C) 2026 Massimiliano Rossi
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see http://www.gnu.org/licenses/ .
+*/
+/*!
+   \file extend_stats.hpp
+   \brief extend_stats.hpp Per-thread profiling counters of the extension of the reads.
+   \author Massimiliano Rossi
+   \date 18/10/2026
+*/
+
+#ifndef _EXTEND_STATS_HH
+#define _EXTEND_STATS_HH
+
+#include <common.hpp>
+
+#include <atomic>
+#include <deque>
+#include <iomanip>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+// Phases of the extension of a read. The timed regions do not overlap.
+enum extend_phase
+{
+    PH_MS_QUERY = 0, // Matching statistics pointers
+    PH_MS_LENGTHS,   // Matching statistics lengths, from the pointers
+    PH_EXTRACT,      // Reference extraction
+    PH_SCORE_DP,     // Score-only dynamic programming
+    PH_FULL_DP,      // Dynamic programming with traceback
+    PH_CIGAR_MD,     // CIGAR, MD:Z and mapping quality
+    PH_WRITE,        // SAM/BAM formatting
+    N_PHASES
+};
+
+static const char *extend_phase_names[N_PHASES] = {
+    "ms.query",
+    "MS lengths",
+    "reference extraction",
+    "score-only DP",
+    "full DP",
+    "CIGAR/MD",
+    "SAM/BAM output"};
+
+// Counter with a single writer, that can be read by the reporter thread while
+// the writer updates it. The update is a plain load and store.
+class stat_counter
+{
+public:
+    inline void add(const uint64_t x)
+    {
+        v.store(v.load(std::memory_order_relaxed) + x, std::memory_order_relaxed);
+    }
+
+    inline uint64_t get() const
+    {
+        return v.load(std::memory_order_relaxed);
+    }
+
+protected:
+    std::atomic<uint64_t> v{0};
+};
+
+// Histogram with bins [2^(b-1), 2^b), and the bin 0 for the value 0.
+class log2_histogram
+{
+public:
+    static constexpr size_t n_bins = 65;
+
+    inline void add(const uint64_t x)
+    {
+        bins[bin(x)].add(1);
+        sum.add(x);
+    }
+
+    static inline size_t bin(const uint64_t x)
+    {
+        return (x == 0 ? 0 : 64 - __builtin_clzll(x));
+    }
+
+    // Add the counts of the histogram to res, and its sum to res_sum.
+    void sum_to(std::vector<uint64_t> &res, uint64_t &res_sum) const
+    {
+        res.resize(n_bins, 0);
+        for (size_t i = 0; i < n_bins; ++i)
+            res[i] += bins[i].get();
+        res_sum += sum.get();
+    }
+
+protected:
+    stat_counter bins[n_bins];
+    stat_counter sum;
+};
+
+// Counters of one thread
+typedef struct extend_stats
+{
+    stat_counter ns[N_PHASES]; // Nanoseconds spent in each phase
+    stat_counter reads;        // Processed reads
+    stat_counter extended;     // Reads with at least one alignment
+    log2_histogram mem_len;    // Length of the longest MEM of each read
+    log2_histogram dp_cells;   // Cells of each dynamic programming matrix
+} extend_stats;
+
+// The counters of the calling thread, null if the thread is not profiled.
+inline extend_stats *&thread_stats()
+{
+    static thread_local extend_stats *stats = nullptr;
+    return stats;
+}
+
+// Adds the time spent in its scope to the phase of the calling thread.
+class phase_timer
+{
+public:
+    phase_timer(const extend_phase phase_) : stats(thread_stats()),
+                                             phase(phase_)
+    {
+        if (stats != nullptr)
+            start = std::chrono::steady_clock::now();
+    }
+
+    ~phase_timer()
+    {
+        if (stats != nullptr)
+            stats->ns[phase].add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    }
+
+protected:
+    extend_stats *stats;
+    const extend_phase phase;
+    std::chrono::steady_clock::time_point start;
+};
+
+inline void stats_mem_len(const size_t len)
+{
+    if (extend_stats *stats = thread_stats())
+        stats->mem_len.add(len);
+}
+
+inline void stats_dp_cells(const size_t cells)
+{
+    if (extend_stats *stats = thread_stats())
+        stats->dp_cells.add(cells);
+}
+
+inline void stats_read(const bool extended)
+{
+    if (extend_stats *stats = thread_stats())
+    {
+        stats->reads.add(1);
+        if (extended)
+            stats->extended.add(1);
+    }
+}
+
+// Owns the counters of the threads. A reporter thread samples the number of
+// processed reads every second to build the histogram of the throughput, and
+// prints the counters every period seconds if period is not 0. The counters
+// are aggregated and printed when the reporter is stopped.
+class stats_reporter
+{
+public:
+    stats_reporter(const size_t period_ = 0) : period(period_)
+    {
+        t_start = std::chrono::steady_clock::now();
+        sampler = std::thread(&stats_reporter::run, this);
+    }
+
+    ~stats_reporter()
+    {
+        stop();
+    }
+
+    // Returns the counters of a new thread.
+    extend_stats *add()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stats.emplace_back();
+        return &stats.back();
+    }
+
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (stopped)
+                return;
+            stopped = true;
+        }
+        cv.notify_all();
+        sampler.join();
+
+        std::lock_guard<std::mutex> lock(mtx);
+        report("Extension profile");
+    }
+
+protected:
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        uint64_t last_reads = 0;
+        size_t seconds = 0;
+        while (not cv.wait_for(lock, std::chrono::seconds(1), [this] { return stopped; }))
+        {
+            const uint64_t reads = total_reads();
+            throughput.add(reads - last_reads);
+            last_reads = reads;
+
+            if (period > 0 and ++seconds % period == 0)
+                report("Extension profile after " + std::to_string(seconds) + " s");
+        }
+    }
+
+    uint64_t total_reads() const
+    {
+        uint64_t res = 0;
+        for (const auto &s : stats)
+            res += s.reads.get();
+        return res;
+    }
+
+    static std::string fixed(const double x, const int precision = 1)
+    {
+        std::stringstream ss;
+        ss << std::fixed << std::setprecision(precision) << x;
+        return ss.str();
+    }
+
+    static void print_histogram(const std::string &name, const log2_histogram &h)
+    {
+        std::vector<uint64_t> bins;
+        uint64_t sum = 0;
+        h.sum_to(bins, sum);
+        print_histogram(name, bins, sum);
+    }
+
+    static void print_histogram(const std::string &name, const std::vector<uint64_t> &bins, const uint64_t sum)
+    {
+        uint64_t count = 0;
+        std::string res;
+        for (size_t b = 0; b < bins.size(); ++b)
+        {
+            if (bins[b] == 0)
+                continue;
+            count += bins[b];
+            if (b == 0)
+                res += " 0:";
+            else
+                res += " [" + std::to_string(1ULL << (b - 1)) + "," + (b < 64 ? std::to_string(1ULL << b) : std::string("inf")) + "):";
+            res += std::to_string(bins[b]);
+        }
+        if (count == 0)
+            return;
+        verbose(name, "(mean", fixed((double)sum / count) + "):" + res);
+    }
+
+    // Called with mtx held.
+    void report(const std::string &title)
+    {
+        const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count();
+
+        uint64_t ns[N_PHASES] = {0};
+        uint64_t reads = 0, extended = 0, tot_ns = 0;
+        std::vector<uint64_t> mem_bins, cell_bins;
+        uint64_t mem_sum = 0, cell_sum = 0;
+        for (const auto &s : stats)
+        {
+            for (size_t i = 0; i < N_PHASES; ++i)
+                ns[i] += s.ns[i].get();
+            reads += s.reads.get();
+            extended += s.extended.get();
+            s.mem_len.sum_to(mem_bins, mem_sum);
+            s.dp_cells.sum_to(cell_bins, cell_sum);
+        }
+        for (size_t i = 0; i < N_PHASES; ++i)
+            tot_ns += ns[i];
+
+        verbose(title + ":", extended, "/", reads, "reads extended by", stats.size(), "threads,", fixed(reads / std::max(elapsed, 1e-9)), "reads/s");
+        for (size_t i = 0; i < N_PHASES; ++i)
+            verbose(std::string(extend_phase_names[i]) + ":", fixed(ns[i] / 1e9, 3), "s (" + fixed(tot_ns > 0 ? 100.0 * ns[i] / tot_ns : 0.0) + "%)");
+        print_histogram("MEM length", mem_bins, mem_sum);
+        print_histogram("DP cells", cell_bins, cell_sum);
+        print_histogram("Reads/s", throughput);
+    }
+
+    const size_t period; // Seconds between two reports, 0 to report only at the end
+
+    std::deque<extend_stats> stats; // Stable addresses
+    log2_histogram throughput;      // Reads processed in each second
+
+    std::chrono::steady_clock::time_point t_start;
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::thread sampler;
+    bool stopped = false;
+};
+
+#endif /* end of include guard: _EXTEND_STATS_HH */
@@ -0,0 +1,345 @@
+/* extender_base - Front end shared by the extenders: index loading, MEM finding and pairing
+    Copyright (C) 2026 Massimiliano Rossi
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see http://www.gnu.org/licenses/ .
+*/
+/*!
+   \file extender_base.hpp
+   \brief extender_base.hpp Front end shared by the extenders: index loading, MEM finding and pairing.
+   \author Massimiliano Rossi
+   \date 18/10/2026
+*/
+
+#ifndef _EXTENDER_BASE_HH
+#define _EXTENDER_BASE_HH
+
+#include <common.hpp>
+
+#include <unordered_map>
+
+#include <ms_index.hpp>
+
+#include <seqidx.hpp>
+#include <ref_cache.hpp>
+#include <sam_writer.hpp>
+#include <paired_end.hpp>
+#include <extend_stats.hpp>
+
+// The extenders differ only in how a read is aligned around its seed. The
+// derived class derived_t provides
+//
+//     bool align_mem(kseq_t *read, const mem_t &mem, uint8_t strand, alignment_t &aln, ref_cache *cache);
+//
+// that aligns the read extending the MEM mem, and returns true and fills aln
+// if the alignment is good enough. Everything else, from loading the index to
+// finding the MEMs and pairing the mates, is shared.
+template <typename derived_t,
+          typename slp_t,
+          typename ms_t>
+class extender_base : public ms_index<slp_t, ms_t>
+{
+public:
+    using index_t = ms_index<slp_t, ms_t>;
+
+    extender_base(std::string filename,
+                  const size_t min_len_,
+                  const size_t cache_blocks_,
+                  const size_t cache_block_len_,
+                  const size_t rescue_k_,
+                  const bool use_mmap = false) : index_t(filename, use_mmap),
+                                                 min_len(min_len_),
+                                                 cache_blocks(cache_blocks_),
+                                                 cache_block_len(cache_block_len_),
+                                                 rescue_k(rescue_k_)
+    {
+        std::string filename_idx = filename + idx.get_file_extension();
+        verbose("Loading fasta index file: " + filename_idx);
+        std::chrono::high_resolution_clock::time_point t_insert_start = std::chrono::high_resolution_clock::now();
+
+        load_file(idx, filename_idx, use_mmap);
+
+        std::chrono::high_resolution_clock::time_point t_insert_end = std::chrono::high_resolution_clock::now();
+
+        verbose("Fasta index loading complete");
+        verbose("Memory peak: ", malloc_count_peak());
+        verbose("Elapsed time (s): ", std::chrono::duration<double, std::ratio<1>>(t_insert_end - t_insert_start).count());
+    }
+
+    // cache is the reference cache of the calling thread, it is initialized
+    // on its first use. writer_t is either sam_writer or bam_writer.
+    template <typename writer_t>
+    bool extend(kseq_t *read, writer_t *out, uint8_t strand, ref_cache *cache = nullptr)
+    {
+        alignment_t aln;
+        if (not align(read, strand, aln, cache))
+            return false;
+
+        phase_timer timer(PH_WRITE);
+        out->write(aln);
+        return true;
+    }
+
+    // Align the read starting from its longest MEM. Returns true and fills aln
+    // if the score of the alignment is above the minimum score.
+    bool align(kseq_t *read, uint8_t strand, alignment_t &aln, ref_cache *cache = nullptr)
+    {
+        if (cache != nullptr and not cache->ready())
+            cache->init(cache_blocks, cache_block_len);
+
+        mem_t mem = find_longest_mem(read);
+        stats_mem_len(mem.len);
+
+        if (mem.len < min_len)
+            return false;
+
+        return derived().align_mem(read, mem, strand, aln, cache);
+    }
+
+    inline mem_t find_longest_mem(kseq_t *read)
+    {
+        std::vector<size_t> pointers;
+        {
+            phase_timer timer(PH_MS_QUERY);
+            pointers = ms.query(read->seq.s, read->seq.l);
+        }
+
+        phase_timer timer(PH_MS_LENGTHS);
+        std::vector<size_t> lengths;
+        return this->longest_mem(read->seq.s, read->seq.l, pointers, lengths);
+    }
+
+    // Align the read on both strands and keep the best alignment. rev is the
+    // reverse complement of read.
+    bool align_best(kseq_t *read, kseq_t *rev, alignment_t &aln, ref_cache *cache = nullptr)
+    {
+        alignment_t aln_rev;
+        bool fwd_aligned = align(read, 0, aln, cache);
+        bool rev_aligned = align(rev, 1, aln_rev, cache);
+
+        if (rev_aligned and (not fwd_aligned or aln_rev.score > aln.score))
+            std::swap(aln, aln_rev);
+
+        return fwd_aligned or rev_aligned;
+    }
+
+    // Align the two mates of a pair together. r1_rev and r2_rev are the
+    // reverse complements of r1 and r2. If only one mate aligns, the other is
+    // searched in the window of the reference where the insert size places it.
+    // Returns the number of aligned mates.
+    template <typename writer_t>
+    size_t extend_pair(kseq_t *r1, kseq_t *r1_rev, kseq_t *r2, kseq_t *r2_rev, writer_t *out, const insert_size_t &insert, ref_cache *cache = nullptr)
+    {
+        if (cache != nullptr and not cache->ready())
+            cache->init(cache_blocks, cache_block_len);
+
+        alignment_t a1, a2;
+        bool m1 = align_best(r1, r1_rev, a1, cache);
+        bool m2 = align_best(r2, r2_rev, a2, cache);
+
+        return write_pair(r1, r1_rev, r2, r2_rev, a1, m1, a2, m2, out, insert, cache);
+    }
+
+    // Write the two mates of a pair, given their alignments a1 and a2 computed
+    // by align_best, m1 and m2 telling if they aligned. If only one mate
+    // aligned, the other is rescued as in extend_pair. Returns the number of
+    // aligned mates.
+    template <typename writer_t>
+    size_t write_pair(kseq_t *r1, kseq_t *r1_rev, kseq_t *r2, kseq_t *r2_rev, alignment_t &a1, bool m1, alignment_t &a2, bool m2, writer_t *out, const insert_size_t &insert, ref_cache *cache = nullptr)
+    {
+        if (cache != nullptr and not cache->ready())
+            cache->init(cache_blocks, cache_block_len);
+
+        if (m1 and not m2)
+            m2 = rescue(r2, r2_rev, a1, insert, a2, cache);
+        else if (m2 and not m1)
+            m1 = rescue(r1, r1_rev, a2, insert, a1, cache);
+
+        if (not m1)
+        {
+            a1 = alignment_t();
+            a1.read = r1;
+        }
+        if (not m2)
+        {
+            a2 = alignment_t();
+            a2.read = r2;
+        }
+
+        set_pair_fields(a1, m1, a2, m2, insert);
+
+        phase_timer timer(PH_WRITE);
+        out->write(a1);
+        out->write(a2);
+
+        return (m1 ? 1 : 0) + (m2 ? 1 : 0);
+    }
+
+    // Align mate in the window of the reference where it is expected given the
+    // alignment of the other mate, anchor. The alignment starts from the
+    // longest exact match between the mate and the window containing a seed of
+    // length rescue_k.
+    bool rescue(kseq_t *mate, kseq_t *mate_rev, const alignment_t &anchor, const insert_size_t &insert, alignment_t &aln, ref_cache *cache = nullptr)
+    {
+        const size_t seq_start = idx.start(anchor.ref_id);
+        const size_t seq_end = seq_start + idx.length(anchor.ref_id);
+        const size_t a_beg = seq_start + anchor.pos;
+        const size_t a_end = seq_start + aln_end(anchor);
+
+        // In a forward-reverse library the mate is on the opposite strand
+        kseq_t *read = (anchor.reverse() ? mate : mate_rev);
+        uint8_t strand = (anchor.reverse() ? 0 : 1);
+        size_t w_beg = a_beg;
+        size_t w_end = std::min(seq_end, a_beg + insert.high);
+        if (anchor.reverse())
+        {
+            w_beg = (a_end > seq_start + insert.high ? a_end - insert.high : seq_start);
+            w_end = a_end;
+        }
+
+        const size_t k = rescue_k;
+        if (w_end <= w_beg + k or read->seq.l < k)
+            return false;
+
+        const size_t w_len = w_end - w_beg;
+        std::vector<uint8_t> win(w_len);
+        extract_nt4(w_beg, w_len, win.data(), cache);
+
+        std::vector<uint8_t> seq(read->seq.l);
+        for (size_t i = 0; i < read->seq.l; ++i)
+            seq[i] = seq_nt4_table[(int)read->seq.s[i]];
+
+        // Index the k-mers of the window, chaining the occurrences of each k-mer
+        const uint64_t mask = (k < 32 ? (1ULL << (2 * k)) - 1 : (uint64_t)-1);
+        const size_t none = (size_t)-1;
+        std::unordered_map<uint64_t, size_t> last;
+        std::vector<size_t> prev(w_len, none);
+        uint64_t kmer = 0;
+        for (size_t i = 0, l = 0; i < w_len; ++i)
+        {
+            l = (win[i] < 4 ? l + 1 : 0);
+            kmer = ((kmer << 2) | (win[i] & 3)) & mask;
+            if (l >= k)
+            {
+                auto it = last.find(kmer);
+                if (it != last.end())
+                {
+                    prev[i] = it->second;
+                    it->second = i;
+                }
+                else
+                    last[kmer] = i;
+            }
+        }
+
+        // Find the longest exact match extending a seed
+        const size_t max_occ = 64;
+        size_t best_t = 0, best_q = 0, best_len = 0;
+        kmer = 0;
+        for (size_t j = 0, l = 0; j < seq.size(); ++j)
+        {
+            l = (seq[j] < 4 ? l + 1 : 0);
+            kmer = ((kmer << 2) | (seq[j] & 3)) & mask;
+            if (l < k)
+                continue;
+
+            auto it = last.find(kmer);
+            if (it == last.end())
+                continue;
+
+            size_t occ = 0;
+            for (size_t i = it->second; i != none and occ < max_occ; i = prev[i], ++occ)
+            {
+                // The seed ends at i in the window and at j in the read
+                size_t t = i + 1 - k, q = j + 1 - k;
+                while (t > 0 and q > 0 and win[t - 1] == seq[q - 1] and seq[q - 1] < 4)
+                    --t, --q;
+                size_t len = i + 1 - t;
+                while (t + len < w_len and q + len < seq.size() and win[t + len] == seq[q + len] and seq[q + len] < 4)
+                    ++len;
+
+                if (len > best_len)
+                {
+                    best_t = t;
+                    best_q = q;
+                    best_len = len;
+                }
+            }
+        }
+
+        if (best_len < k)
+            return false;
+
+        return derived().align_mem(read, mem_t(w_beg + best_t, best_len, best_q), strand, aln, cache);
+    }
+
+    size_t get_extended_reads()
+    {
+        return extended_reads;
+    }
+
+    // Write in out the nt4 encoding of the reference substring [pos..pos+len-1]
+    inline void extract_nt4(const size_t pos, const size_t len, uint8_t *out, ref_cache *cache)
+    {
+        phase_timer timer(PH_EXTRACT);
+        if (cache != nullptr)
+            cache->extract(ra, n, pos, len, out, seq_nt4_table);
+        else
+            ref_cache::expand(ra, pos, len, out, seq_nt4_table);
+    }
+
+    std::string to_sam()
+    {
+        std::string res = "@HD\tVN:1.6\tSO:unknown\n";
+        res += idx.to_sam();
+        res += "@PG\tID:moni\tPN:moni\tVN:0.1.0\n";
+        return res;
+    }
+
+protected:
+    inline derived_t &derived()
+    {
+        return *static_cast<derived_t *>(this);
+    }
+
+    using index_t::ms;
+    using index_t::ra;
+    using index_t::n;
+
+    seqidx idx;
+
+    const size_t min_len = 0;
+    size_t extended_reads = 0;
+
+    const size_t cache_blocks = 16384; // Number of reference blocks cached per thread
+    const size_t cache_block_len = 256; // Length of the cached reference blocks
+
+    const size_t rescue_k = 12; // Length of the seeds used for mate rescue
+
+    const unsigned char seq_nt4_table[256] = {
+        0, 1, 2, 3, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+        4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+        4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+        4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+        4, 0, 4, 1, 4, 4, 4, 2, 4, 4, 4, 4, 4, 4, 4, 4,
+        4, 4, 4, 4, 3, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+        4, 0, 4, 1, 4, 4, 4, 2, 4, 4, 4, 4, 4, 4, 4, 4,
+        4, 4, 4, 4, 3, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+        4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+        4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+        4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+        4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+        4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+        4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+        4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+        4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4};
+};
+
+#endif /* end of include guard: _EXTENDER_BASE_HH */
@@ -23,57 +23,22 @@
 
 #include <common.hpp>
 
-#include <sdsl/io.hpp>
-
-#include <ms_pointers.hpp>
-
-#include <malloc_count.h>
-
-#include <SelfShapedSlp.hpp>
-#include <DirectAccessibleGammaCode.hpp>
-#include <SelectType.hpp>
-#include <PlainSlp.hpp>
-#include <FixedBitLenCode.hpp>
-
 #include <ksw2.h>
 
 #include <libgen.h>
-#include <seqidx.hpp>
-////////////////////////////////////////////////////////////////////////////////
-/// SLP definitions
-////////////////////////////////////////////////////////////////////////////////
-
-using SelSd = SelectSdvec<>;
-using DagcSd = DirectAccessibleGammaCode<SelSd>;
-using Fblc = FixedBitLenCode<>;
-
-using shaped_slp_t = SelfShapedSlp<uint32_t, DagcSd, DagcSd, SelSd>;
-using plain_slp_t = PlainSlp<uint32_t, Fblc, Fblc>;
-
-template <typename slp_t>
-std::string get_slp_file_extension()
-{
-    return std::string(".slp");
-}
-
-template <>
-std::string get_slp_file_extension<shaped_slp_t>()
-{
-    return std::string(".slp");
-}
-
-template <>
-std::string get_slp_file_extension<plain_slp_t>()
-{
-    return std::string(".plain.slp");
-}
-////////////////////////////////////////////////////////////////////////////////
+#include <extender_base.hpp>
+#include <bam_writer.hpp>
+#include <ksw2_extension.hpp>
 
 template <typename slp_t,
           typename ms_t>
-class extender
+class extender : public extender_base<extender<slp_t, ms_t>, slp_t, ms_t>
 {
 public:
+    using base_t = extender_base<extender<slp_t, ms_t>, slp_t, ms_t>;
+    using base_t::extend;
+    using base_t::extract_nt4;
+
     // using SelSd = SelectSdvec<>;
     // using DagcSd = DirectAccessibleGammaCode<SelSd>;
     // using SlpT = SelfShapedSlp<uint32_t, DagcSd, DagcSd, SelSd>;
@@ -97,8 +62,19 @@ public:
         int w = -1;             // Band width
         int zdrop = -1;         // Zdrop enable
 
+        bool local = false;     // Stop the extensions at their best scoring end and soft-clip the rest
+        int clip_bonus = 5;     // End bonus in local mode: a read end is reached only if it scores at least max - clip_bonus
+        int local_zdrop = 100;  // Zdrop used in local mode if zdrop is disabled
+
         bool forward_only = true;      // Align only 
 
+        size_t cache_blocks = 16384;   // Number of reference blocks cached per thread (0 disables the cache)
+        size_t cache_block_len = 256;  // Length of the cached reference blocks
+
+        size_t rescue_k = 12;          // Length of the seeds used for mate rescue
+
+        bool mmap = false;             // Read the index files through a memory mapping
+
     } config_t;
 
     // extender(std::string filename,
@@ -108,7 +84,7 @@ public:
 
     extender(std::string filename,
             config_t config = config_t()) : 
-                min_len(config.min_len),        // Minimum MEM length
+                base_t(filename, config.min_len, config.cache_blocks, config.cache_block_len, config.rescue_k, config.mmap),
                 ext_len(config.ext_len),        // Extension length
                 top_k(config.top_k),            // Report the top_k alignments
                 smatch(config.smatch),          // Match score default
@@ -117,69 +93,27 @@ public:
                 gapo2(config.gapo2),            // Gap open penalty
                 gape(config.gape),              // Gap extension penalty
                 gape2(config.gape2),            // Gap extension penalty
-                end_bonus(config.end_bonus),    // Bonus to add at the extension score to declare the alignment
+                end_bonus(config.local ? config.clip_bonus : config.end_bonus), // Bonus to add at the extension score to declare the alignment
                 w(config.w),                    // Band width
-                zdrop(config.zdrop),            // Zdrop enable
+                zdrop(config.local and config.zdrop < 0 ? config.local_zdrop : config.zdrop), // Zdrop enable
+                local(config.local),
                 forward_only(config.forward_only)
     {
-        verbose("Loading the matching statistics index");
-        std::chrono::high_resolution_clock::time_point t_insert_start = std::chrono::high_resolution_clock::now();
-
-        std::string filename_ms = filename + ms.get_file_extension();
-
-        ifstream fs_ms(filename_ms);
-        ms.load(fs_ms);
-        fs_ms.close();
-
-        std::chrono::high_resolution_clock::time_point t_insert_end = std::chrono::high_resolution_clock::now();
-
-        verbose("Matching statistics index construction complete");
-        verbose("Memory peak: ", malloc_count_peak());
-        verbose("Elapsed time (s): ", std::chrono::duration<double, std::ratio<1>>(t_insert_end - t_insert_start).count());
-
-        std::string filename_slp = filename + get_slp_file_extension<slp_t>();
-        verbose("Loading random access file: " + filename_slp);
-        t_insert_start = std::chrono::high_resolution_clock::now();
-
-        ifstream fs(filename_slp);
-        ra.load(fs);
-        fs.close();
-
-        n = ra.getLen();
-
-        t_insert_end = std::chrono::high_resolution_clock::now();
-
-        verbose("Matching statistics index loading complete");
-        verbose("Memory peak: ", malloc_count_peak());
-        verbose("Elapsed time (s): ", std::chrono::duration<double, std::ratio<1>>(t_insert_end - t_insert_start).count());
-
-        std::string filename_idx = filename + idx.get_file_extension();
-        verbose("Loading fasta index file: " + filename_idx);
-        t_insert_start = std::chrono::high_resolution_clock::now();
-
-
-        ifstream fs_idx(filename_idx);
-        idx.load(fs_idx);
-        fs_idx.close();
-
-        t_insert_end = std::chrono::high_resolution_clock::now();
-
-        verbose("Fasta index loading complete");
-        verbose("Memory peak: ", malloc_count_peak());
-        verbose("Elapsed time (s): ", std::chrono::duration<double, std::ratio<1>>(t_insert_end - t_insert_start).count());
-
         verbose("Initialize the local aligner");
-        t_insert_start = std::chrono::high_resolution_clock::now();
+        std::chrono::high_resolution_clock::time_point t_insert_start = std::chrono::high_resolution_clock::now();
 
         ksw_gen_simple_mat(m, mat, smatch, -smismatch);
 
-        t_insert_end = std::chrono::high_resolution_clock::now();
+        std::chrono::high_resolution_clock::time_point t_insert_end = std::chrono::high_resolution_clock::now();
 
         verbose("Local aligner initialization complete");
         verbose("Memory peak: ", malloc_count_peak());
         verbose("Elapsed time (s): ", std::chrono::duration<double, std::ratio<1>>(t_insert_end - t_insert_start).count());
 
         verbose("Minimum MEM length: ", min_len);
+        if (local)
+            verbose("Local extension: end bonus ", end_bonus, ", zdrop ", zdrop);
+        verbose("Reference cache: ", cache_blocks, " blocks of ", cache_block_len, " characters per thread");
 
     }
 
@@ -189,120 +123,57 @@ public:
         // NtD
     }
 
-    bool extend(kseq_t *read, FILE *out, uint8_t strand)
+    // Align the read extending the MEM mem. Returns true and fills aln if the
+    // score of the alignment is above the minimum score.
+    bool align_mem(kseq_t *read, const mem_t &mem, uint8_t strand, alignment_t &aln, ref_cache *cache = nullptr)
     {
-
-        bool extended = false;
-
-        mem_t mem = find_longest_mem(read);
-
-        // Extend the read
-        if (mem.len >= min_len)
+        bool aligned = false;
+
+        // Extractin left and right context of the read
+        // lcs: left context sequence
+        size_t lcs_len = mem.idx;
+        uint8_t *lcs = (uint8_t *)malloc(lcs_len);
+        // Convert A,C,G,T,N into 0,1,2,3,4
+        // The left context is reversed
+        for (size_t i = 0; i < lcs_len; ++i)
+            lcs[lcs_len - i - 1] = seq_nt4_table[(int)read->seq.s[i]];
+
+        // rcs: right context sequence
+        size_t rcs_occ = (mem.idx + mem.len); // The first character of the right context
+        size_t rcs_len = read->seq.l - rcs_occ;
+        uint8_t *rcs = (uint8_t *)malloc(rcs_len);
+        // Convert A,C,G,T,N into 0,1,2,3,4
+        for (size_t i = 0; i < rcs_len; ++i)
+            rcs[i] = seq_nt4_table[(int)read->seq.s[rcs_occ + i]];
+
+        int32_t min_score = 20 + 8 * log(read->seq.l);
+
+        int32_t score = extend(
+            mem.pos,
+            mem.len,
+            lcs,     // Left context of the read
+            lcs_len, // Left context of the read lngth
+            rcs,     // Right context of the read
+            rcs_len, // Right context of the read length
+            true, 0, 0, nullptr, 0, nullptr, false,
+            cache
+        );
+
+        if (score > min_score)
         {
-
-            // Extractin left and right context of the read
-            // lcs: left context sequence
-            size_t lcs_len = mem.idx;
-            uint8_t *lcs = (uint8_t *)malloc(lcs_len);
-            // verbose("lcs: " + std::string(read->seq.s).substr(0,lcs_len));
-            // Convert A,C,G,T,N into 0,1,2,3,4
-            // The left context is reversed
-            for (size_t i = 0; i < lcs_len; ++i)
-                lcs[lcs_len - i - 1] = seq_nt4_table[(int)read->seq.s[i]];
-
-            // rcs: right context sequence
-            size_t rcs_occ = (mem.idx + mem.len); // The first character of the right context
-            size_t rcs_len = read->seq.l - rcs_occ;
-            uint8_t *rcs = (uint8_t *)malloc(rcs_len);
-            // verbose("rcs: " + std::string(read->seq.s).substr(rcs_occ,rcs_len));
-            // Convert A,C,G,T,N into 0,1,2,3,4
-            for (size_t i = 0; i < rcs_len; ++i)
-                rcs[i] = seq_nt4_table[(int)read->seq.s[rcs_occ + i]];
-
-            int32_t min_score = 20 + 8 * log(read->seq.l);
-            // verbose("Number of occurrences: " + std::to_string(occs.size()));
-
-            int32_t score = extend(
-                mem.pos,
-                mem.len,
-                lcs,     // Left context of the read
-                lcs_len, // Left context of the read lngth
-                rcs,     // Right context of the read
-                rcs_len  // Right context of the read length
-            );
-
-            if (score > min_score)
-            {
-                extend(mem.pos, mem.len, lcs, lcs_len, rcs, rcs_len, false, 0, min_score, read, strand, out);
-                extended = true;
-            }
-            
-            delete lcs;
-            delete rcs;
+            extend(mem.pos, mem.len, lcs, lcs_len, rcs, rcs_len, false, 0, min_score, read, strand, &aln, false, cache);
+            aligned = true;
         }
-        return extended;
-    }
 
-    typedef struct mem_t
-    {
-        size_t pos = 0;           // Position in the reference
-        size_t len = 0;           // Length
-        size_t idx = 0;           // Position in the pattern
+        free(lcs);
+        free(rcs);
 
-        mem_t(size_t p, size_t l, size_t i)
-        {
-            pos = p; // Position in the reference
-            len = l; // Length of the MEM
-            idx = i; // Position in the read
-        }
-
-    } mem_t;
-
-    inline mem_t find_longest_mem(kseq_t *read)
-    {
-        size_t mem_pos = 0;
-        size_t mem_len = 0;
-        size_t mem_idx = 0;
-
-        auto pointers = ms.query(read->seq.s, read->seq.l);
-        std::vector<size_t> lengths(pointers.size());
-        size_t l = 0;
-        size_t n_Ns = 0;
-        for (size_t i = 0; i < pointers.size(); ++i)
-        {
-            size_t pos = pointers[i];
-            while ((i + l) < read->seq.l && (pos + l) < n && read->seq.s[i + l] == ra.charAt(pos + l))
-            {
-                if (read->seq.s[i + l] == 'N')
-                    n_Ns++;
-                else
-                    n_Ns = 0;
-                ++l;
-            }
-
-            lengths[i] = l;
-            l = (l == 0 ? 0 : (l - 1));
-
-            // Update MEM
-            if (lengths[i] > mem_len and n_Ns < lengths[i])
-            {
-                mem_len = lengths[i];
-                mem_pos = pointers[i];
-                mem_idx = i;
-            }
-        }
-
-        return mem_t(mem_pos, mem_len, mem_idx);
-    }
-
-    size_t get_extended_reads()
-    {
-        return extended_reads;
+        return aligned;
     }
 
     // If score_only is true we compute the score of the alignment.
-    // If score_only is false, we extend again the read and we write the result
-    // in the SAM file, so we need to give the second best score.
+    // If score_only is false, we extend again the read and we store the result
+    // in aln, so we need to give the second best score.
     int32_t extend(
         const size_t mem_pos,
         const size_t mem_len,
@@ -315,8 +186,9 @@ public:
         const int32_t min_score = 0,  // The minimum score to call an alignment
         const kseq_t *read = nullptr, // The read that has been aligned
         int8_t strand = 0,            // 0: forward aligned ; 1: reverse complement aligned
-        FILE *out = nullptr,          // The SAM file pointer
-        const bool realign = false    // Realign globally the read
+        alignment_t *aln = nullptr,   // The resulting alignment
+        const bool realign = false,   // Realign globally the read
+        ref_cache *cache = nullptr    // The reference cache of the calling thread
     )
     {
         int flag = KSW_EZ_EXTZ_ONLY | KSW_EZ_RIGHT;
@@ -326,6 +198,9 @@ public:
 
         int score_lc = 0;
         int score_rc = 0;
+        // Number of characters of the contexts aligned in the read and in the reference
+        size_t lc_q = 0, lc_t = 0;
+        size_t rc_q = 0, rc_t = 0;
 
         ksw_extz_t ez_lc;
         ksw_extz_t ez_rc;
@@ -342,30 +217,29 @@ public:
         {
             size_t lc_occ = (mem_pos > ext_len ? mem_pos - ext_len : 0);
             size_t lc_len = (mem_pos > ext_len ? ext_len : ext_len - mem_pos);
-            char *tmp_lc = (char *)malloc(ext_len);
-            ra.expandSubstr(lc_occ, lc_len, tmp_lc);
-            // verbose("lc: " + std::string(lc));
             // Convert A,C,G,T,N into 0,1,2,3,4
             // The left context is reversed
             uint8_t *lc = (uint8_t *)malloc(ext_len);
-            for (size_t i = 0; i < lc_len; ++i)
-                lc[lc_len - i - 1] = seq_nt4_table[(int)tmp_lc[i]];
-
-            delete tmp_lc;
+            extract_nt4(lc_occ, lc_len, lc, cache);
+            std::reverse(lc, lc + lc_len);
 
             // Query: lcs
             // Target: lc
             // verbose("aligning lc and lcs");
-            ksw_extz2_sse(km, lcs_len, (uint8_t *)lcs, lc_len, (uint8_t *)lc, m, mat, gapo, gape, w, zdrop, end_bonus, flag, &ez_lc);
-            score_lc = ez_lc.mqe;
+            {
+                phase_timer timer(score_only ? PH_SCORE_DP : PH_FULL_DP);
+                ksw_extz2_sse(km, lcs_len, (uint8_t *)lcs, lc_len, (uint8_t *)lc, m, mat, gapo, gape, w, zdrop, end_bonus, flag, &ez_lc);
+            }
+            stats_dp_cells(lcs_len * lc_len);
+            score_lc = extension_end(ez_lc, lcs_len, lc_q, lc_t);
             // verbose("lc score: " + std::to_string(score_lc));
             // Check if the extension reached the end or the query
-            assert(score_only or ez_lc.reach_end);
+            assert(score_only or local or ez_lc.zdropped or ez_lc.reach_end);
 
             // std::string blc = print_BLAST_like((uint8_t*)lc,(uint8_t*)lcs,ez_lc.cigar,ez_lc.n_cigar);
             // std::cout<<blc;
 
-            delete lc;
+            free(lc);
         }
 
         // rc: right context
@@ -374,25 +248,26 @@ public:
         {
             size_t rc_occ = mem_pos + mem_len;
             size_t rc_len = (rc_occ < n - ext_len ? ext_len : n - rc_occ);
-            char *rc = (char *)malloc(ext_len);
-            ra.expandSubstr(rc_occ, rc_len, rc);
-            // verbose("rc: " + std::string(rc));
             // Convert A,C,G,T,N into 0,1,2,3,4
-            for (size_t i = 0; i < rc_len; ++i)
-                rc[i] = seq_nt4_table[(int)rc[i]];
+            uint8_t *rc = (uint8_t *)malloc(ext_len);
+            extract_nt4(rc_occ, rc_len, rc, cache);
 
             // Query: rcs
             // Target: rc
             // verbose("aligning rc and rcs");
-            ksw_extz2_sse(km, rcs_len, (uint8_t *)rcs, rc_len, (uint8_t *)rc, m, mat, gapo, gape, w, zdrop, end_bonus, flag, &ez_rc);
-            score_rc = ez_rc.mqe;
+            {
+                phase_timer timer(score_only ? PH_SCORE_DP : PH_FULL_DP);
+                ksw_extz2_sse(km, rcs_len, (uint8_t *)rcs, rc_len, (uint8_t *)rc, m, mat, gapo, gape, w, zdrop, end_bonus, flag, &ez_rc);
+            }
+            stats_dp_cells(rcs_len * rc_len);
+            score_rc = extension_end(ez_rc, rcs_len, rc_q, rc_t);
             // verbose("rc score: " + std::to_string(score_rc));
             // Check if the extension reached the end or the query
-            assert(score_only or ez_rc.reach_end);
+            assert(score_only or local or ez_rc.zdropped or ez_rc.reach_end);
 
             // std::string brc = print_BLAST_like((uint8_t*)rc,(uint8_t*)rcs,ez_rc.cigar,ez_rc.n_cigar);
             // std::cout<<brc;
-            delete rc;
+            free(rc);
         }
 
         // Compute the final score
@@ -401,13 +276,14 @@ public:
         if (not score_only)
         {
             // Compute starting position in reference
-            size_t ref_pos = mem_pos - (lcs_len > 0 ? ez_lc.mqe_t + 1 : 0);
-            size_t ref_len = (lcs_len > 0 ? ez_lc.mqe_t + 1 : 0) + mem_len + (rcs_len > 0 ? ez_rc.mqe_t + 1 : 0);
-            char *ref = (char *)malloc(ref_len);
-            ra.expandSubstr(ref_pos, ref_len, ref);
+            size_t ref_pos = mem_pos - lc_t;
+            size_t ref_len = lc_t + mem_len + rc_t;
+            // Soft-clipped characters at the two ends of the read
+            size_t l_clip = lcs_len - lc_q;
+            size_t r_clip = rcs_len - rc_q;
             // Convert A,C,G,T,N into 0,1,2,3,4
-            for (size_t i = 0; i < ref_len; ++i)
-                ref[i] = seq_nt4_table[(int)ref[i]];
+            uint8_t *ref = (uint8_t *)malloc(ref_len);
+            extract_nt4(ref_pos, ref_len, ref, cache);
 
             // Convert the read
             size_t seq_len = read->seq.l;
@@ -415,14 +291,20 @@ public:
             for (size_t i = 0; i < seq_len; ++i)
                 seq[i] = seq_nt4_table[(int)read->seq.s[i]];
 
-            char *tmp = (char *)calloc(max(ref_len, seq_len), 1);
+            aln->read = read;
+            aln->flag = (strand ? 16 : 0);
+            aln->score2 = score2;
 
             if (realign)
             {
-                // Realign the whole sequence globally
+                // Realign the whole sequence globally, except the soft-clipped ends
                 flag = KSW_EZ_RIGHT;
                 ksw_reset_extz(&ez);
-                ksw_extz2_sse(km, seq_len, (uint8_t *)seq, ref_len, (uint8_t *)ref, m, mat, gapo, gape, w, zdrop, end_bonus, flag, &ez);
+                {
+                    phase_timer timer(PH_FULL_DP);
+                    ksw_extz2_sse(km, seq_len - l_clip - r_clip, (uint8_t *)seq + l_clip, ref_len, (uint8_t *)ref, m, mat, gapo, gape, w, zdrop, end_bonus, flag, &ez);
+                }
+                stats_dp_cells((seq_len - l_clip - r_clip) * ref_len);
 
                 // std::string bfull = print_BLAST_like((uint8_t*)ref,seq,ez.cigar,ez.n_cigar);
                 // std::cout << bfull;
@@ -446,68 +328,72 @@ public:
 
                 assert(ez.score >= score);
 
-                // Concatenate the CIGAR strings
-
-                std::string cigar_s;
-                for (size_t i = 0; i < ez.n_cigar; ++i)
-                    cigar_s += std::to_string(ez.cigar[i] >> 4) + "MID"[ez.cigar[i] & 0xf];
-
-                // Compute the MD:Z field and thenumber of mismatches
-                std::pair<std::string, size_t> md_nm = write_MD_core((uint8_t *)ref, seq, ez.cigar, ez.n_cigar, tmp, 0);
-                std::pair<std::string,size_t> pos = idx.index(ref_pos);
-                write_sam(ez.score, score2, min_score, pos.second, pos.first.c_str(), read, strand, out, cigar_s, md_nm.first, md_nm.second);
+                phase_timer timer(PH_CIGAR_MD);
+                aln->cigar.clear();
+                if (l_clip > 0)
+                    aln->cigar.push_back(((uint32_t)l_clip << 4) | 4);
+                aln->cigar.insert(aln->cigar.end(), ez.cigar, ez.cigar + ez.n_cigar);
+                if (r_clip > 0)
+                    aln->cigar.push_back(((uint32_t)r_clip << 4) | 4);
+                aln->score = ez.score;
             }
             else
             {
+                phase_timer timer(PH_CIGAR_MD);
                 // Concatenate the CIGAR strings
-                size_t n_cigar = ez_lc.n_cigar + ez_rc.n_cigar + 1;
-                uint32_t *cigar = (uint32_t *)calloc(n_cigar, sizeof(uint32_t));
-                size_t i = 0;
+                std::vector<uint32_t> &cigar = aln->cigar;
+                cigar.clear();
+                cigar.reserve(ez_lc.n_cigar + ez_rc.n_cigar + 3);
+
+                if (l_clip > 0)
+                    cigar.push_back(((uint32_t)l_clip << 4) | 4);
 
                 for (size_t j = 0; j < ez_lc.n_cigar; ++j)
-                    cigar[i++] = ez_lc.cigar[ez_lc.n_cigar - j - 1];
+                    cigar.push_back(ez_lc.cigar[ez_lc.n_cigar - j - 1]);
 
-                if (ez_lc.n_cigar > 0 and ((cigar[i - 1] & 0xf) == 0))
+                if (ez_lc.n_cigar > 0 and ((cigar.back() & 0xf) == 0))
                 { // If the previous operation is also an M then merge the two operations
-                    cigar[i - 1] += (((uint32_t)mem_len) << 4);
-                    --n_cigar;
+                    cigar.back() += (((uint32_t)mem_len) << 4);
                 }
                 else
-                    cigar[i++] = (((uint32_t)mem_len) << 4);
+                    cigar.push_back(((uint32_t)mem_len) << 4);
 
                 if (ez_rc.n_cigar > 0)
                 {
                     if ((ez_rc.cigar[0] & 0xf) == 0)
                     { // If the next operation is also an M then merge the two operations
-                        cigar[i - 1] += ez_rc.cigar[0];
-                        --n_cigar;
+                        cigar.back() += ez_rc.cigar[0];
                     }
                     else
-                        cigar[i++] = ez_rc.cigar[0];
+                        cigar.push_back(ez_rc.cigar[0]);
                 }
 
                 for (size_t j = 1; j < ez_rc.n_cigar; ++j)
-                    cigar[i++] = ez_rc.cigar[j];
+                    cigar.push_back(ez_rc.cigar[j]);
 
-                assert(i <= n_cigar);
+                if (r_clip > 0)
+                    cigar.push_back(((uint32_t)r_clip << 4) | 4);
 
-                // std::string bfull = print_BLAST_like((uint8_t*)ref,seq,cigar,n_cigar);
+                // std::string bfull = print_BLAST_like((uint8_t*)ref,seq,cigar.data(),cigar.size());
                 // std::cout << bfull;
 
-                std::string cigar_s;
-                for (size_t i = 0; i < n_cigar; ++i)
-                    cigar_s += std::to_string(cigar[i] >> 4) + "MID"[cigar[i] & 0xf];
-
-                // Compute the MD:Z field and thenumber of mismatches
-                std::pair<std::string, size_t> md_nm = write_MD_core((uint8_t *)ref, seq, cigar, n_cigar, tmp, 0);
-                std::pair<std::string,size_t> pos = idx.index(ref_pos);
-                write_sam(score, score2, min_score, pos.second, pos.first.c_str(), read, strand, out, cigar_s, md_nm.first, md_nm.second);
-
-                delete cigar;
+                aln->score = score;
             }
-            delete tmp;
-            delete ref;
-            delete seq;
+
+            // Compute the MD:Z field and thenumber of mismatches
+            phase_timer timer(PH_CIGAR_MD);
+            aln->md.clear();
+            aln->nm = write_MD_core((uint8_t *)ref, seq, aln->cigar.data(), aln->cigar.size(), aln->md);
+            std::pair<size_t,size_t> pos = idx.index_id(ref_pos);
+            aln->ref_id = pos.first;
+            aln->ref_name = idx.name(pos.first);
+            aln->pos = pos.second;
+            // The MAPQ is computed on the aligned part and scaled by its fraction of the read
+            size_t aligned_len = seq_len - l_clip - r_clip;
+            aln->mapq = compute_mapq(aln->score, score2, min_score, aligned_len) * aligned_len / seq_len;
+
+            free(ref);
+            free(seq);
         }
 
         if (ez_lc.m_cigar > 0)
@@ -521,26 +407,31 @@ public:
     }
 
 
+    // Returns the score of the extension ez of a query of length qlen, and the
+    // number of query and target characters it aligns.
+    inline int32_t extension_end(const ksw_extz_t &ez, const size_t qlen, size_t &q_len, size_t &t_len)
+    {
+        return ksw2_extension_end(ez, qlen, local, end_bonus, q_len, t_len);
+    }
+
     // Readapted from https://github.com/lh3/minimap2/blob/c9874e2dc50e32bbff4ded01cf5ec0e9be0a53dd/format.c
-    // tmp is a string of length max(reference length, query length)
-    static std::pair<std::string, size_t> write_MD_core(const uint8_t *tseq, const uint8_t *qseq, const uint32_t *cigar, const size_t n_cigar, char *tmp, int write_tag)
+    // The MD:Z string is written in mdz, and the number of mismatches is returned.
+    static size_t write_MD_core(const uint8_t *tseq, const uint8_t *qseq, const uint32_t *cigar, const size_t n_cigar, std::string &mdz)
     {
-        std::string mdz;
         int i, q_off, t_off, l_MD = 0, NM = 0;
-        if (write_tag)
-            mdz += "MD:Z:"; //printf("MD:Z:");
+        mdz.clear();
         for (i = q_off = t_off = 0; i < (int)n_cigar; ++i)
         {
             int j, op = cigar[i] & 0xf, len = cigar[i] >> 4;
-            assert((op >= 0 && op <= 3) || op == 7 || op == 8);
+            assert((op >= 0 && op <= 4) || op == 7 || op == 8);
             if (op == 0 || op == 7 || op == 8)
             { // match
                 for (j = 0; j < len; ++j)
                 {
                     if (qseq[q_off + j] != tseq[t_off + j])
                     {
-                        mdz += std::to_string(l_MD) + "ACGTN"[tseq[t_off + j]];
-                        // printf("%d%c", l_MD, "ACGTN"[tseq[t_off + j]]);
+                        append_uint(mdz, l_MD);
+                        mdz += "ACGTN"[tseq[t_off + j]];
                         l_MD = 0;
                         ++NM;
                     }
@@ -556,10 +447,10 @@ public:
             }
             else if (op == 2)
             { // deletion from ref
-                for (j = 0, tmp[len] = 0; j < len; ++j)
-                    tmp[j] = "ACGTN"[tseq[t_off + j]];
-                mdz += std::to_string(l_MD) + "^" + std::string(tmp);
-                // printf("%d^%s", l_MD, tmp);
+                append_uint(mdz, l_MD);
+                mdz += '^';
+                for (j = 0; j < len; ++j)
+                    mdz += "ACGTN"[tseq[t_off + j]];
                 l_MD = 0;
                 t_off += len;
                 NM += len;
@@ -568,11 +459,15 @@ public:
             { // reference skip
                 t_off += len;
             }
+            else if (op == 4)
+            { // soft clip
+                q_off += len;
+            }
         }
         if (l_MD > 0)
-            mdz += std::to_string(l_MD); //printf("%d", l_MD);
+            append_uint(mdz, l_MD);
         // assert(t_off == r->re - r->rs && q_off == r->qe - r->qs);
-        return make_pair(mdz, NM);
+        return NM;
     }
 
     // From https://github.com/lh3/ksw2/blob/master/cli.c
@@ -591,57 +486,6 @@ public:
             mat[(m - 1) * m + j] = 0;
     }
 
-    // Adapted from https://github.com/mengyao/Complete-Striped-Smith-Waterman-Library/blob/master/src/main.c
-    void write_sam(const int32_t score,
-                   const int32_t score2,
-                   const int32_t min_score,
-                   size_t ref_pos,
-                   const char *ref_seq_name,
-                   const kseq_t *read,
-                   int8_t strand, // 0: forward aligned ; 1: reverse complement aligned
-                   FILE *out,
-                   std::string &cigar,
-                   std::string &md,
-                   size_t mismatches)
-    {
-        // Sam format output
-        fprintf(out, "%s\t", read->name.s);
-        if (score == 0)
-            fprintf(out, "4\t*\t0\t255\t*\t*\t0\t0\t*\t*\n");
-        else
-        {
-            int32_t c, p;
-            // uint32_t mapq = -4.343 * log(1 - (double)abs(score - score2) / (double)score);
-            // mapq = (uint32_t)(mapq + 4.99);
-            // mapq = mapq < 254 ? mapq : 254;
-            uint32_t mapq = compute_mapq(score, score2, min_score, read->seq.l);
-            if (strand)
-                fprintf(out, "16\t");
-            else
-                fprintf(out, "0\t");
-            // TODO: Find the correct reference name.
-            fprintf(out, "%s\t%d\t%d\t", ref_seq_name, ref_pos + 1, mapq);
-            fprintf(out, "%s", cigar.c_str());
-            fprintf(out, "\t*\t0\t0\t");
-            fprintf(out, "%s", read->seq.s);
-            fprintf(out, "\t");
-            if (read->qual.s && strand)
-            {
-                for (p = read->qual.l - 1; p >= 0; --p)
-                    fprintf(out, "%c", read->qual.s[p]);
-            }
-            else if (read->qual.s)
-                fprintf(out, "%s", read->qual.s);
-            else
-                fprintf(out, "*");
-            fprintf(out, "\tAS:i:%d", score);
-            fprintf(out, "\tNM:i:%d", mismatches);
-            if (score2 > 0)
-                fprintf(out, "\tZS:i:%d", score2);
-            fprintf(out, "\tMD:Z:%s\n", md.c_str());
-        }
-    }
-
     /*!
     Compute the mapping quality of the alignment
     Inspired from https://github.com/BenLangmead/bowtie2/blob/4512b199768e562e8627ffdfd9253affc96f6fc6/unique.h
@@ -736,44 +580,19 @@ public:
         return target_o + "\n" + bars_o + "\n" + seq_o + "\n";
     }
 
-    std::string to_sam()
-    {
-        std::string res = "@HD VN:1.6 SO:unknown\n";
-        res += idx.to_sam();
-        res += "@PG\tID:moni\tPN:moni\tVN:0.1.0\n";
-        return res; 
-    }
-
 protected:
-    ms_t ms;
-    slp_t ra;
-    seqidx idx;
-    // SelfShapedSlp<uint32_t, DagcSd, DagcSd, SelSd> ra;
+    using base_t::ms;
+    using base_t::ra;
+    using base_t::idx;
+    using base_t::n;
+    using base_t::min_len;
+    using base_t::seq_nt4_table;
+    using base_t::cache_blocks;
+    using base_t::cache_block_len;
 
-    const size_t min_len = 0;
     const size_t ext_len = 100;   // Extension length
-    size_t extended_reads = 0;
-    size_t n = 0;
     const size_t top_k = 1; // report the top_k alignments
 
-    const unsigned char seq_nt4_table[256] = {
-        0, 1, 2, 3, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
-        4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
-        4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
-        4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
-        4, 0, 4, 1, 4, 4, 4, 2, 4, 4, 4, 4, 4, 4, 4, 4,
-        4, 4, 4, 4, 3, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
-        4, 0, 4, 1, 4, 4, 4, 2, 4, 4, 4, 4, 4, 4, 4, 4,
-        4, 4, 4, 4, 3, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
-        4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
-        4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
-        4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
-        4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
-        4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
-        4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
-        4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
-        4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4};
-
     const int8_t smatch = 2;    // Match score default
     const int8_t smismatch = 4; // Mismatch score default
     const int8_t gapo = 4;      // Gap open penalty
@@ -785,6 +604,8 @@ protected:
     const int w = -1; // Band width
     const int zdrop = -1;
 
+    const bool local = false; // Soft-clip the read ends that do not improve the score
+
     void *km = 0; // Kalloc
 
     // int8_t max_rseq = 0;
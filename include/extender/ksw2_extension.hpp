@@ -0,0 +1,48 @@
+/* ksw2_extension - End of the extensions computed with ksw2
+    Copyright (C) 2026 Massimiliano Rossi
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see http://www.gnu.org/licenses/ .
+*/
+/*!
+   \file ksw2_extension.hpp
+   \brief ksw2_extension.hpp End of the extensions computed with ksw2.
+   \author Massimiliano Rossi
+   \date 18/10/2026
+*/
+
+#ifndef _KSW2_EXTENSION_HH
+#define _KSW2_EXTENSION_HH
+
+#include <cstddef>
+#include <cstdint>
+
+#include <ksw2.h>
+
+// Returns the score of the extension ez of a query of length qlen, and the
+// number of query and target characters it aligns. In local mode the
+// extension stops at the best scoring cell unless reaching the end of the
+// query scores at least max - end_bonus. If the extension z-dropped, mqe and
+// mqe_t are not computed on the whole query, and ksw2 backtracks from the
+// best scoring cell, so the extension ends there.
+inline int32_t ksw2_extension_end(const ksw_extz_t &ez, const size_t qlen, const bool local, const int end_bonus, size_t &q_len, size_t &t_len)
+{
+    if (not ez.zdropped and (not local or ez.mqe + end_bonus > ez.max))
+    {
+        q_len = qlen;
+        t_len = ez.mqe_t + 1;
+        return ez.mqe;
+    }
+    q_len = ez.max_q + 1;
+    t_len = ez.max_t + 1;
+    return ez.max;
+}
+
+#endif /* end of include guard: _KSW2_EXTENSION_HH */
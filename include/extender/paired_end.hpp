@@ -0,0 +1,189 @@
+/* paired_end - Insert size estimation and pairing of the alignments of two mates
+    Copyright (C) 2026 Massimiliano Rossi
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see http://www.gnu.org/licenses/ .
+*/
+/*!
+   \file paired_end.hpp
+   \brief paired_end.hpp Insert size estimation and pairing of the alignments of two mates.
+   \author Massimiliano Rossi
+   \date 18/10/2026
+*/
+
+#ifndef _PAIRED_END_HH
+#define _PAIRED_END_HH
+
+#include <common.hpp>
+
+#include <cmath>
+#include <algorithm>
+
+#include <sam_writer.hpp>
+
+// The library is assumed to be forward-reverse: the leftmost mate is aligned
+// on the forward strand and the other one on the reverse strand.
+
+// SAM flags of paired reads
+static const uint16_t SAM_PAIRED = 0x1;
+static const uint16_t SAM_PROPER_PAIR = 0x2;
+static const uint16_t SAM_UNMAPPED = 0x4;
+static const uint16_t SAM_MATE_UNMAPPED = 0x8;
+static const uint16_t SAM_REVERSE = 0x10;
+static const uint16_t SAM_MATE_REVERSE = 0x20;
+static const uint16_t SAM_FIRST = 0x40;
+static const uint16_t SAM_SECOND = 0x80;
+
+// Number of pairs aligned to estimate the insert size
+static const size_t INSERT_PILOT_PAIRS = 10000;
+// Minimum number of observations needed to trust the estimate
+static const size_t INSERT_MIN_OBSERVATIONS = 25;
+
+typedef struct insert_size_t
+{
+    double mean = 500;   // Mean insert size
+    double stddev = 150; // Standard deviation of the insert size
+    size_t low = 1;      // Minimum insert size of a proper pair
+    size_t high = 1100;  // Maximum insert size of a proper pair, also used for mate rescue
+    size_t n = 0;        // Number of observations used for the estimate
+} insert_size_t;
+
+// Alignments of the two mates of a pair computed by align_best, before the
+// mate rescue. The pairs aligned to estimate the insert size are kept, and
+// written without aligning them again.
+typedef struct pilot_pair_t
+{
+    alignment_t a1;
+    alignment_t a2;
+    bool m1 = false; // True if the first mate is aligned
+    bool m2 = false; // True if the second mate is aligned
+} pilot_pair_t;
+
+// Rightmost reference position (excluded) of the alignment
+inline size_t aln_end(const alignment_t &aln)
+{
+    return aln.pos + cigar_ref_len(aln.cigar);
+}
+
+// True if the two mates are on the same sequence, on opposite strands, with
+// the forward mate not on the right of the reverse mate.
+inline bool is_fr(const alignment_t &a1, const alignment_t &a2)
+{
+    if (a1.ref_id != a2.ref_id or a1.reverse() == a2.reverse())
+        return false;
+    const alignment_t &fwd = (a1.reverse() ? a2 : a1);
+    const alignment_t &rev = (a1.reverse() ? a1 : a2);
+    return fwd.pos <= rev.pos + cigar_ref_len(rev.cigar);
+}
+
+// Length of the reference covered by the two mates
+inline size_t template_len(const alignment_t &a1, const alignment_t &a2)
+{
+    return std::max(aln_end(a1), aln_end(a2)) - std::min(a1.pos, a2.pos);
+}
+
+/**
+ * @brief Estimate the insert size distribution from the observed template lengths.
+ * Outliers are removed using the interquartile range, as in BWA.
+ *
+ * @param obs the template lengths of the pairs aligned in FR orientation.
+ * @param def the distribution to return if there are too few observations.
+ */
+inline insert_size_t estimate_insert_size(std::vector<size_t> &obs, const insert_size_t &def = insert_size_t())
+{
+    if (obs.size() < INSERT_MIN_OBSERVATIONS)
+    {
+        verbose("Too few pairs to estimate the insert size (", obs.size(), "), using the default");
+        return def;
+    }
+
+    std::sort(obs.begin(), obs.end());
+    const size_t q25 = obs[obs.size() / 4];
+    const size_t q50 = obs[obs.size() / 2];
+    const size_t q75 = obs[(3 * obs.size()) / 4];
+    const size_t iqr = q75 - q25;
+
+    // Mean and standard deviation without the outliers
+    const size_t out_low = (q25 > 2 * iqr ? q25 - 2 * iqr : 0);
+    const size_t out_high = q75 + 2 * iqr;
+    double sum = 0, sum2 = 0;
+    size_t n = 0;
+    for (auto l : obs)
+        if (l >= out_low and l <= out_high)
+        {
+            sum += l;
+            sum2 += (double)l * l;
+            ++n;
+        }
+
+    insert_size_t res;
+    res.n = n;
+    res.mean = sum / n;
+    res.stddev = std::sqrt(std::max(0.0, sum2 / n - res.mean * res.mean));
+    res.low = (q25 > 3 * iqr + 1 ? q25 - 3 * iqr : 1);
+    res.high = std::max(q75 + 3 * iqr, (size_t)(res.mean + 4 * res.stddev));
+
+    verbose("Insert size: ", n, " pairs, quartiles ", q25, " ", q50, " ", q75);
+    verbose("Insert size: mean ", res.mean, ", std ", res.stddev, ", proper pairs in [", res.low, ",", res.high, "]");
+    return res;
+}
+
+/**
+ * @brief Set the flags, the mate fields and the template length of the two mates.
+ *
+ * @param m1 true if the first mate is aligned.
+ * @param m2 true if the second mate is aligned.
+ */
+inline void set_pair_fields(alignment_t &a1, const bool m1, alignment_t &a2, const bool m2, const insert_size_t &insert)
+{
+    a1.flag = (m1 ? (a1.flag & SAM_REVERSE) : SAM_UNMAPPED) | SAM_PAIRED | SAM_FIRST;
+    a2.flag = (m2 ? (a2.flag & SAM_REVERSE) : SAM_UNMAPPED) | SAM_PAIRED | SAM_SECOND;
+
+    a1.flag |= (m2 ? (a2.flag & SAM_REVERSE ? SAM_MATE_REVERSE : 0) : SAM_MATE_UNMAPPED);
+    a2.flag |= (m1 ? (a1.flag & SAM_REVERSE ? SAM_MATE_REVERSE : 0) : SAM_MATE_UNMAPPED);
+    a1.tlen = a2.tlen = 0;
+
+    if (not m1 and not m2)
+        return;
+
+    // An unmapped mate is placed at the position of the aligned one
+    if (not m1 or not m2)
+    {
+        alignment_t &mapped = (m1 ? a1 : a2);
+        alignment_t &unmapped = (m1 ? a2 : a1);
+
+        unmapped.ref_id = mapped.ref_id;
+        unmapped.ref_name = mapped.ref_name;
+        unmapped.pos = mapped.pos;
+    }
+
+    a1.mate_ref_id = a2.ref_id;
+    a1.mate_ref_name = a2.ref_name;
+    a1.mate_pos = a2.pos;
+    a2.mate_ref_id = a1.ref_id;
+    a2.mate_ref_name = a1.ref_name;
+    a2.mate_pos = a1.pos;
+
+    if (m1 and m2 and a1.ref_id == a2.ref_id)
+    {
+        const int64_t tlen = template_len(a1, a2);
+        const bool first_left = (a1.pos <= a2.pos);
+        a1.tlen = (first_left ? tlen : -tlen);
+        a2.tlen = -a1.tlen;
+
+        if (is_fr(a1, a2) and (size_t)tlen >= insert.low and (size_t)tlen <= insert.high)
+        {
+            a1.flag |= SAM_PROPER_PAIR;
+            a2.flag |= SAM_PROPER_PAIR;
+        }
+    }
+}
+
+#endif /* end of include guard: _PAIRED_END_HH */
@@ -0,0 +1,216 @@
+/* ref_cache - LRU cache of nt4-encoded reference blocks extracted from the SLP
+    Copyright (C) 2026 Massimiliano Rossi
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see http://www.gnu.org/licenses/ .
+*/
+/*!
+   \file ref_cache.hpp
+   \brief ref_cache.hpp LRU cache of nt4-encoded reference blocks extracted from the SLP.
+   \author Massimiliano Rossi
+   \date 18/10/2026
+*/
+
+#ifndef _REF_CACHE_HH
+#define _REF_CACHE_HH
+
+#include <common.hpp>
+
+#include <cstring>
+#include <unordered_map>
+
+// The reference is split in blocks of block_len characters, aligned to
+// multiples of block_len. Each block is decoded from the grammar at most once
+// while it stays in the cache, and it is stored already converted in nt4.
+// The cache is not thread safe: each worker owns its own instance.
+class ref_cache
+{
+public:
+    ref_cache()
+    {
+        // NtD
+    }
+
+    ref_cache(const size_t n_blocks_, const size_t block_len_)
+    {
+        init(n_blocks_, block_len_);
+    }
+
+    /**
+     * @brief Allocate n_blocks_ blocks of block_len_ characters and empty the cache.
+     * If n_blocks_ is 0, every request is decoded directly from the grammar.
+     */
+    void init(const size_t n_blocks_, const size_t block_len_)
+    {
+        assert(block_len_ > 0);
+
+        n_blocks = n_blocks_;
+        block_len = block_len_;
+        used = 0;
+        head = tail = npos;
+
+        data.resize(n_blocks * block_len);
+        tag = std::vector<size_t>(n_blocks, npos);
+        prev = std::vector<size_t>(n_blocks, npos);
+        next = std::vector<size_t>(n_blocks, npos);
+        slots.clear();
+        slots.reserve(n_blocks);
+
+        initialized = true;
+    }
+
+    inline bool ready() const
+    {
+        return initialized;
+    }
+
+    /**
+     * @brief Write in out the nt4 encoding of the reference substring [pos..pos+len-1].
+     *
+     * @param ra the random access data structure of the reference.
+     * @param n the length of the reference.
+     * @param nt4 the table converting characters in nt4.
+     */
+    template <typename slp_t>
+    void extract(const slp_t &ra, const size_t n, const size_t pos, const size_t len, uint8_t *out, const unsigned char *nt4)
+    {
+        assert(pos + len <= n);
+
+        if (n_blocks == 0)
+        {
+            expand(ra, pos, len, out, nt4);
+            return;
+        }
+
+        size_t i = 0;
+        while (i < len)
+        {
+            const size_t b = (pos + i) / block_len;
+            const size_t off = (pos + i) - b * block_len;
+            const size_t l = std::min(block_len - off, len - i);
+
+            const uint8_t *blk = block(ra, n, b, nt4);
+            memcpy(out + i, blk + off, l);
+            i += l;
+        }
+    }
+
+    // Decode the reference substring [pos..pos+len-1] bypassing the cache.
+    template <typename slp_t>
+    static void expand(const slp_t &ra, const size_t pos, const size_t len, uint8_t *out, const unsigned char *nt4)
+    {
+        ra.expandSubstr(pos, len, (char *)out);
+        for (size_t i = 0; i < len; ++i)
+            out[i] = nt4[out[i]];
+    }
+
+    inline size_t hits() const
+    {
+        return n_hits;
+    }
+
+    inline size_t misses() const
+    {
+        return n_misses;
+    }
+
+protected:
+    static constexpr size_t npos = (size_t)-1;
+
+    // Return the pointer to the b-th block of the reference, decoding it if needed.
+    template <typename slp_t>
+    const uint8_t *block(const slp_t &ra, const size_t n, const size_t b, const unsigned char *nt4)
+    {
+        auto it = slots.find(b);
+        if (it != slots.end())
+        {
+            ++n_hits;
+            touch(it->second);
+            return data.data() + it->second * block_len;
+        }
+
+        ++n_misses;
+
+        // Take a free slot, or evict the least recently used block.
+        size_t s = 0;
+        if (used < n_blocks)
+            s = used++;
+        else
+        {
+            s = tail;
+            unlink(s);
+            slots.erase(tag[s]);
+        }
+
+        const size_t b_pos = b * block_len;
+        expand(ra, b_pos, std::min(block_len, n - b_pos), data.data() + s * block_len, nt4);
+
+        tag[s] = b;
+        slots[b] = s;
+        push_front(s);
+
+        return data.data() + s * block_len;
+    }
+
+    // Move the slot s in front of the recency list.
+    inline void touch(const size_t s)
+    {
+        if (s == head)
+            return;
+        unlink(s);
+        push_front(s);
+    }
+
+    inline void unlink(const size_t s)
+    {
+        if (prev[s] != npos)
+            next[prev[s]] = next[s];
+        else
+            head = next[s];
+
+        if (next[s] != npos)
+            prev[next[s]] = prev[s];
+        else
+            tail = prev[s];
+
+        prev[s] = next[s] = npos;
+    }
+
+    inline void push_front(const size_t s)
+    {
+        prev[s] = npos;
+        next[s] = head;
+        if (head != npos)
+            prev[head] = s;
+        head = s;
+        if (tail == npos)
+            tail = s;
+    }
+
+    bool initialized = false;
+
+    size_t n_blocks = 0;  // Number of blocks in the cache
+    size_t block_len = 1; // Length of each block
+    size_t used = 0;      // Number of slots already filled
+
+    std::vector<uint8_t> data; // n_blocks * block_len nt4 characters
+    std::vector<size_t> tag;   // Block stored in each slot
+    std::vector<size_t> prev;  // Recency list, from the most recently used
+    std::vector<size_t> next;
+    size_t head = npos;
+    size_t tail = npos;
+
+    std::unordered_map<size_t, size_t> slots; // Block -> slot
+
+    size_t n_hits = 0;
+    size_t n_misses = 0;
+};
+
+#endif /* end of include guard: _REF_CACHE_HH */
@@ -0,0 +1,316 @@
+/* sam_writer - Buffered writer of SAM records
+    Copyright (C) 2026 Massimiliano Rossi
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see http://www.gnu.org/licenses/ .
+*/
+/*!
+   \file sam_writer.hpp
+   \brief sam_writer.hpp Buffered writer of SAM records.
+   \author Massimiliano Rossi
+   \date 18/10/2026
+*/
+
+#ifndef _SAM_WRITER_HH
+#define _SAM_WRITER_HH
+
+#include <common.hpp>
+
+#include <cstring>
+#include <algorithm>
+
+#include <kseq.h>
+
+////////////////////////////////////////////////////////////////////////////////
+/// Integer formatting
+////////////////////////////////////////////////////////////////////////////////
+
+static const char digits_pairs[201] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+// Write the decimal representation of v in s and return its length.
+// s must have room for 20 characters.
+inline size_t u64toa(uint64_t v, char *s)
+{
+    char tmp[20];
+    char *p = tmp + 20;
+    while (v >= 100)
+    {
+        const size_t d = (v % 100) * 2;
+        v /= 100;
+        *--p = digits_pairs[d + 1];
+        *--p = digits_pairs[d];
+    }
+    if (v >= 10)
+    {
+        const size_t d = v * 2;
+        *--p = digits_pairs[d + 1];
+        *--p = digits_pairs[d];
+    }
+    else
+        *--p = (char)('0' + v);
+
+    const size_t l = tmp + 20 - p;
+    memcpy(s, p, l);
+    return l;
+}
+
+// s must have room for 21 characters.
+inline size_t i64toa(int64_t v, char *s)
+{
+    if (v < 0)
+    {
+        *s = '-';
+        return 1 + u64toa(-(uint64_t)v, s + 1);
+    }
+    return u64toa((uint64_t)v, s);
+}
+
+// Append the decimal representation of v to str.
+inline void append_uint(std::string &str, uint64_t v)
+{
+    char tmp[20];
+    str.append(tmp, u64toa(v, tmp));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Alignment record
+////////////////////////////////////////////////////////////////////////////////
+
+// CIGAR operations are stored as in ksw2 and BAM: (length << 4) | operation
+static const char cigar_ops[] = "MIDNSHP=X";
+
+typedef struct alignment_t
+{
+    const kseq_t *read = nullptr;  // The aligned read
+    uint16_t flag = 4;             // SAM flag
+    int32_t ref_id = -1;           // Index of the reference sequence
+    std::string ref_name = "*";    // Name of the reference sequence
+    size_t pos = 0;                // 0-based leftmost position in the reference sequence
+    uint32_t mapq = 255;           // Mapping quality
+    std::vector<uint32_t> cigar;   // CIGAR operations
+    int32_t score = 0;             // Alignment score
+    int32_t score2 = 0;            // Score of the second best alignment
+    size_t nm = 0;                 // Edit distance to the reference
+    std::string md;                // MD:Z string, not written if empty
+
+    // Paired-end reads
+    int32_t mate_ref_id = -1;         // Index of the reference sequence of the mate, -1 if not available
+    std::string mate_ref_name = "*";  // Name of the reference sequence of the mate
+    size_t mate_pos = 0;              // 0-based leftmost position of the mate
+    int64_t tlen = 0;                 // Observed template length
+
+    inline bool reverse() const
+    {
+        return flag & 16;
+    }
+} alignment_t;
+
+// Number of reference characters covered by the CIGAR
+inline size_t cigar_ref_len(const std::vector<uint32_t> &cigar)
+{
+    size_t len = 0;
+    for (auto c : cigar)
+    {
+        const uint32_t op = c & 0xf;
+        if (op == 0 or op == 2 or op == 3 or op == 7 or op == 8)
+            len += c >> 4;
+    }
+    return len;
+}
+
+// True if the read has one quality per base. The copies of FASTA reads have a
+// non-null qual.s of length 0.
+inline bool has_qual(const kseq_t *read)
+{
+    return read->qual.s and read->qual.l == read->seq.l;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// SAM writer
+////////////////////////////////////////////////////////////////////////////////
+
+// Records are formatted in a buffer that is written to the file only once
+// it holds at least capacity bytes. The writer is not thread safe: each
+// worker owns its own instance.
+class sam_writer
+{
+public:
+    sam_writer(FILE *fd_, const size_t capacity_ = (1 << 22)) : fd(fd_),
+                                                                 capacity(capacity_)
+    {
+        size = capacity + (1 << 16);
+        if ((buf = (char *)malloc(size)) == nullptr)
+            error("malloc() sam_writer buffer failed");
+    }
+
+    ~sam_writer()
+    {
+        flush();
+        free(buf);
+    }
+
+    void write(const alignment_t &aln)
+    {
+        const kseq_t *read = aln.read;
+
+        reserve(read->name.l + 2 * read->seq.l + 21 * aln.cigar.size() +
+                aln.ref_name.size() + aln.mate_ref_name.size() + aln.md.size() + 256);
+
+        put(read->name.s, read->name.l);
+        put('\t');
+
+        if ((aln.flag & 4) and not(aln.flag & 1))
+        {
+            put_uint(aln.flag);
+            put("\t*\t0\t255\t*\t*\t0\t0\t*\t*\n", 21);
+        }
+        else if (aln.flag & 4)
+        {
+            // Unmapped mate, placed at the position of the other mate if any
+            put_uint(aln.flag);
+            put('\t');
+            if (aln.ref_id >= 0)
+            {
+                put(aln.ref_name.data(), aln.ref_name.size());
+                put('\t');
+                put_uint(aln.pos + 1);
+            }
+            else
+                put("*\t0", 3);
+            put("\t0\t*", 4);
+            put_mate(aln);
+            put('\t');
+            put(read->seq.s, read->seq.l);
+            put('\t');
+            if (has_qual(read))
+                put(read->qual.s, read->qual.l);
+            else
+                put('*');
+            put('\n');
+        }
+        else
+        {
+            put_uint(aln.flag);
+            put('\t');
+            put(aln.ref_name.data(), aln.ref_name.size());
+            put('\t');
+            put_uint(aln.pos + 1);
+            put('\t');
+            put_uint(aln.mapq);
+            put('\t');
+            for (auto c : aln.cigar)
+            {
+                put_uint(c >> 4);
+                put(cigar_ops[c & 0xf]);
+            }
+            put_mate(aln);
+            put('\t');
+            put(read->seq.s, read->seq.l);
+            put('\t');
+            if (has_qual(read) and aln.reverse())
+            {
+                std::reverse_copy(read->qual.s, read->qual.s + read->qual.l, buf + len);
+                len += read->qual.l;
+            }
+            else if (has_qual(read))
+                put(read->qual.s, read->qual.l);
+            else
+                put('*');
+            put("\tAS:i:", 6);
+            put_int(aln.score);
+            put("\tNM:i:", 6);
+            put_uint(aln.nm);
+            if (aln.score2 > 0)
+            {
+                put("\tZS:i:", 6);
+                put_int(aln.score2);
+            }
+            if (aln.md.size() > 0)
+            {
+                put("\tMD:Z:", 6);
+                put(aln.md.data(), aln.md.size());
+            }
+            put('\n');
+        }
+
+        if (len >= capacity)
+            flush();
+    }
+
+    // Write the buffered records in the file.
+    void flush()
+    {
+        if (len > 0 and fwrite(buf, sizeof(char), len, fd) != len)
+            error("fwrite() SAM records failed");
+        len = 0;
+    }
+
+protected:
+    // Write the RNEXT, PNEXT and TLEN fields, preceded by a tab.
+    inline void put_mate(const alignment_t &aln)
+    {
+        put('\t');
+        if (aln.mate_ref_id < 0)
+        {
+            put("*\t0\t0", 5);
+            return;
+        }
+        if (aln.mate_ref_id == aln.ref_id)
+            put('=');
+        else
+            put(aln.mate_ref_name.data(), aln.mate_ref_name.size());
+        put('\t');
+        put_uint(aln.mate_pos + 1);
+        put('\t');
+        put_int(aln.tlen);
+    }
+
+    // Make room for at least l more characters in the buffer.
+    inline void reserve(const size_t l)
+    {
+        if (len + l <= size)
+            return;
+        size = std::max(2 * size, len + l);
+        if ((buf = (char *)realloc(buf, size)) == nullptr)
+            error("realloc() sam_writer buffer failed");
+    }
+
+    inline void put(const char c)
+    {
+        buf[len++] = c;
+    }
+
+    inline void put(const char *s, const size_t l)
+    {
+        memcpy(buf + len, s, l);
+        len += l;
+    }
+
+    inline void put_uint(const uint64_t v)
+    {
+        len += u64toa(v, buf + len);
+    }
+
+    inline void put_int(const int64_t v)
+    {
+        len += i64toa(v, buf + len);
+    }
+
+    FILE *fd;
+    char *buf = nullptr;
+    size_t len = 0;      // Number of buffered characters
+    size_t size = 0;     // Size of the buffer
+    size_t capacity = 0; // Flush threshold
+};
+
+#endif /* end of include guard: _SAM_WRITER_HH */
@@ -0,0 +1,129 @@
+/* moni - Library interface to query and extend reads against a MONI index
+    Copyright (C) 2026 Massimiliano Rossi
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see http://www.gnu.org/licenses/ .
+*/
+/*!
+   \file moni.hpp
+   \brief moni.hpp Library interface to query and extend reads against a MONI index.
+   \author Massimiliano Rossi
+   \date 18/10/2026
+
+   The header depends only on the standard library, the index structures are
+   hidden in libmoni. An Index can be queried by several threads at the same
+   time.
+
+       auto index = moni::Index::open("ref.fa");
+       moni::ms_result ms = index->query_ms("ACGTTGCA");
+       moni::alignment aln = index->extend({"read1", "ACGTTGCA", ""});
+*/
+
+#ifndef _MONI_HH
+#define _MONI_HH
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace moni
+{
+
+    // Grammar used for the random access to the reference, as the -g option of
+    // moni build.
+    enum class grammar
+    {
+        plain,
+        shaped
+    };
+
+    struct options
+    {
+        grammar slp = grammar::plain;
+        bool mmap = false;          // Read the index files through a memory mapping
+        bool extension = true;      // Load the .idx file and the aligner, needed by extend()
+
+        size_t min_len = 25;        // Minimum MEM length to extend a read
+        size_t ext_len = 100;       // Length of the reference aligned beyond each end of the read
+        bool local = false;         // Soft-clip the read ends that do not align
+        size_t cache_blocks = 16384; // Reference blocks cached by each thread of the batch extension
+
+        size_t threads = 1;         // Threads used by the batch queries
+    };
+
+    // Matching statistics of a sequence: for each suffix, the position of the
+    // reference where its longest prefix occurs, and the length of the prefix.
+    struct ms_result
+    {
+        std::vector<size_t> pointers;
+        std::vector<size_t> lengths;
+    };
+
+    struct mem
+    {
+        size_t read_pos = 0; // Position in the sequence
+        size_t length = 0;   // Length of the MEM
+        size_t ref_pos = 0;  // Position in the reference
+    };
+
+    struct read
+    {
+        std::string name;
+        std::string seq;
+        std::string qual; // Empty for FASTA reads
+    };
+
+    struct alignment
+    {
+        bool aligned = false;
+        uint16_t flag = 4;         // SAM flag
+        std::string ref_name = "*";
+        size_t pos = 0;            // 0-based leftmost position in the reference sequence
+        uint32_t mapq = 255;
+        std::string cigar = "*";
+        int32_t score = 0;
+        size_t nm = 0;             // Edit distance to the reference
+        std::string md;            // MD:Z string
+    };
+
+    class Index
+    {
+    public:
+        virtual ~Index() = default;
+
+        // Opens the index built by moni build with the given prefix. Throws
+        // std::runtime_error if a file of the index is missing, or if the
+        // index has shards, added with moni add or built with --shards.
+        static std::unique_ptr<Index> open(const std::string &prefix, const options &opts = options());
+
+        // Length of the reference
+        virtual size_t length() const = 0;
+
+        virtual ms_result query_ms(const std::string &seq) = 0;
+        virtual std::vector<mem> query_mems(const std::string &seq) = 0;
+
+        // Aligns the read on the strand where it scores best, extending its
+        // longest MEM. Throws std::logic_error if the index was opened without
+        // extension.
+        virtual alignment extend(const read &r) = 0;
+
+        // Batch versions, run on options::threads threads
+        virtual std::vector<ms_result> query_ms(const std::vector<std::string> &seqs) = 0;
+        virtual std::vector<std::vector<mem>> query_mems(const std::vector<std::string> &seqs) = 0;
+        virtual std::vector<alignment> extend(const std::vector<read> &reads) = 0;
+
+        // SAM header with the reference sequences
+        virtual std::string sam_header() = 0;
+    };
+
+} // namespace moni
+
+#endif /* end of include guard: _MONI_HH */
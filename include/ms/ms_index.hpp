@@ -0,0 +1,234 @@
+/* ms_index - Matching statistics index with random access to the reference
+    Copyright (C) 2026 Massimiliano Rossi
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see http://www.gnu.org/licenses/ .
+*/
+/*!
+   \file ms_index.hpp
+   \brief ms_index.hpp Matching statistics index with random access to the reference.
+   \author Massimiliano Rossi
+   \date 18/10/2026
+*/
+
+#ifndef _MS_INDEX_HH
+#define _MS_INDEX_HH
+
+#include <common.hpp>
+
+#include <sdsl/io.hpp>
+
+#include <ms_pointers.hpp>
+
+#include <malloc_count.h>
+
+#include <SelfShapedSlp.hpp>
+#include <DirectAccessibleGammaCode.hpp>
+#include <SelectType.hpp>
+#include <PlainSlp.hpp>
+#include <FixedBitLenCode.hpp>
+
+#include <mmap_stream.hpp>
+
+////////////////////////////////////////////////////////////////////////////////
+/// SLP definitions
+////////////////////////////////////////////////////////////////////////////////
+
+using SelSd = SelectSdvec<>;
+using DagcSd = DirectAccessibleGammaCode<SelSd>;
+using Fblc = FixedBitLenCode<>;
+
+using shaped_slp_t = SelfShapedSlp<uint32_t, DagcSd, DagcSd, SelSd>;
+using plain_slp_t = PlainSlp<uint32_t, Fblc, Fblc>;
+
+template <typename slp_t>
+std::string get_slp_file_extension()
+{
+    return std::string(".slp");
+}
+
+template <>
+inline std::string get_slp_file_extension<shaped_slp_t>()
+{
+    return std::string(".slp");
+}
+
+template <>
+inline std::string get_slp_file_extension<plain_slp_t>()
+{
+    return std::string(".plain.slp");
+}
+////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////
+/// Thresholds definitions
+////////////////////////////////////////////////////////////////////////////////
+
+using ms_relative_t = ms_pointers<ri::sparse_sd_vector, ms_rle_string_sd, thr_relative<ms_rle_string_sd>>;
+using ms_compact_t = ms_pointers<ri::sparse_sd_vector, ms_rle_string_sd, thr_bv_compact<ms_rle_string_sd>>;
+using ms_fused_t = ms_pointers<ri::sparse_sd_vector, ms_rle_string_sd, thr_fused<ms_rle_string_sd>>;
+
+// True if the index with prefix filename has the matching statistics pointers
+// of ms_t, whose file extension depends on the thresholds.
+template <typename ms_t>
+bool has_ms_file(const std::string &filename)
+{
+    struct stat filestat;
+    return stat((filename + ms_t().get_file_extension()).c_str(), &filestat) == 0;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+typedef struct mem_t
+{
+    size_t pos = 0;           // Position in the reference
+    size_t len = 0;           // Length
+    size_t idx = 0;           // Position in the pattern
+
+    mem_t(size_t p, size_t l, size_t i)
+    {
+        pos = p; // Position in the reference
+        len = l; // Length of the MEM
+        idx = i; // Position in the read
+    }
+
+} mem_t;
+
+// The matching statistics pointers of ms_t and the random access to the
+// reference of slp_t, loaded from the files of the index with prefix filename.
+// The front ends compute the lengths of the matching statistics and the MEMs
+// from here.
+template <typename slp_t,
+          typename ms_t = ms_pointers<>>
+class ms_index
+{
+public:
+    // If use_mmap is true the files of the index are read through a memory
+    // mapping instead of a buffered stream.
+    ms_index(std::string filename, const bool use_mmap = false)
+    {
+        verbose("Loading the matching statistics index");
+        std::chrono::high_resolution_clock::time_point t_insert_start = std::chrono::high_resolution_clock::now();
+
+        std::string filename_ms = filename + ms.get_file_extension();
+        load_file(ms, filename_ms, use_mmap);
+
+        std::chrono::high_resolution_clock::time_point t_insert_end = std::chrono::high_resolution_clock::now();
+
+        verbose("Matching statistics index construction complete");
+        verbose("Memory peak: ", malloc_count_peak());
+        verbose("Elapsed time (s): ", std::chrono::duration<double, std::ratio<1>>(t_insert_end - t_insert_start).count());
+
+        std::string filename_slp = filename + get_slp_file_extension<slp_t>();
+        verbose("Loading random access file: " + filename_slp);
+        t_insert_start = std::chrono::high_resolution_clock::now();
+
+        load_file(ra, filename_slp, use_mmap);
+
+        n = ra.getLen();
+
+        t_insert_end = std::chrono::high_resolution_clock::now();
+
+        verbose("Matching statistics index loading complete");
+        verbose("Memory peak: ", malloc_count_peak());
+        verbose("Elapsed time (s): ", std::chrono::duration<double, std::ratio<1>>(t_insert_end - t_insert_start).count());
+    }
+
+    // Length of the reference
+    inline size_t length() const
+    {
+        return n;
+    }
+
+    // Matching statistics pointers of s[0..m-1]
+    inline std::vector<size_t> query(const char *s, const size_t m)
+    {
+        return ms.query(s, m);
+    }
+
+    // Lengths of the matching statistics of s[0..m-1] given their pointers.
+    // The pointer of a suffix following the one of the previous suffix is not
+    // checked against the reference, its length is inherited.
+    void lengths(const char *s, const size_t m, const std::vector<size_t> &pointers, std::vector<size_t> &lengths)
+    {
+        lengths.resize(pointers.size());
+        size_t l = 0;
+        for (size_t i = 0; i < pointers.size(); ++i)
+        {
+            size_t pos = pointers[i];
+            while ((i + l) < m && (pos + l) < n && (i < 1 || pos != (pointers[i - 1] + 1)) && s[i + l] == ra.charAt(pos + l))
+                ++l;
+
+            lengths[i] = l;
+            l = (l == 0 ? 0 : (l - 1));
+        }
+    }
+
+    // Matching statistics of s[0..m-1]
+    void matching_statistics(const char *s, const size_t m, std::vector<size_t> &pointers, std::vector<size_t> &lengths_)
+    {
+        pointers = ms.query(s, m);
+        lengths(s, m, pointers, lengths_);
+    }
+
+    // Positions in the pattern and lengths of the MEMs, from the lengths of the
+    // matching statistics.
+    static void mems(const std::vector<size_t> &lengths, std::vector<std::pair<size_t, size_t>> &res)
+    {
+        res.clear();
+        for (size_t i = 0; i < lengths.size(); ++i)
+            if ((i == 0) or (lengths[i] >= lengths[i - 1]))
+                res.push_back(std::make_pair(i, lengths[i]));
+    }
+
+    // Longest MEM of s[0..m-1] that is not a run of Ns, computing the lengths
+    // of the matching statistics given their pointers.
+    mem_t longest_mem(const char *s, const size_t m, const std::vector<size_t> &pointers, std::vector<size_t> &lengths)
+    {
+        size_t mem_pos = 0;
+        size_t mem_len = 0;
+        size_t mem_idx = 0;
+
+        lengths.resize(pointers.size());
+        size_t l = 0;
+        size_t n_Ns = 0;
+        for (size_t i = 0; i < pointers.size(); ++i)
+        {
+            size_t pos = pointers[i];
+            while ((i + l) < m && (pos + l) < n && s[i + l] == ra.charAt(pos + l))
+            {
+                if (s[i + l] == 'N')
+                    n_Ns++;
+                else
+                    n_Ns = 0;
+                ++l;
+            }
+
+            lengths[i] = l;
+            l = (l == 0 ? 0 : (l - 1));
+
+            // Update MEM
+            if (lengths[i] > mem_len and n_Ns < lengths[i])
+            {
+                mem_len = lengths[i];
+                mem_pos = pointers[i];
+                mem_idx = i;
+            }
+        }
+
+        return mem_t(mem_pos, mem_len, mem_idx);
+    }
+
+protected:
+    ms_t ms;
+    slp_t ra;
+    size_t n = 0;
+};
+
+#endif /* end of include guard: _MS_INDEX_HH */
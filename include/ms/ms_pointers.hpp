@@ -65,7 +65,9 @@ public:
 
     ms_pointers() {}
 
-    ms_pointers(std::string filename, bool rle = false) : ri::r_index<sparse_bv_type, rle_string_t>()
+    // The structures that depend only on the BWT are built concurrently on the
+    // given number of threads.
+    ms_pointers(std::string filename, bool rle = false, size_t threads = 1) : ri::r_index<sparse_bv_type, rle_string_t>()
     {
         verbose("Building the r-index from BWT");
 
@@ -75,17 +77,20 @@ public:
 
         verbose("RLE encoding BWT and computing SA samples");
 
+        std::vector<std::function<void()>> tasks;
         if (rle)
         {
             std::string bwt_heads_fname = bwt_fname + ".heads";
             std::ifstream ifs_heads(bwt_heads_fname);
             std::string bwt_len_fname = bwt_fname + ".len";
             std::ifstream ifs_len(bwt_len_fname);
-            this->bwt = rle_string_t(ifs_heads, ifs_len);
+            this->bwt = rle_string_t(ifs_heads, ifs_len, 2, threads);
 
-            ifs_heads.seekg(0);
-            ifs_len.seekg(0);
-            this->build_F_(ifs_heads, ifs_len);
+            tasks.push_back([this, bwt_heads_fname, bwt_len_fname]() {
+                std::ifstream ifs_heads(bwt_heads_fname);
+                std::ifstream ifs_len(bwt_len_fname);
+                this->build_F_(ifs_heads, ifs_len);
+            });
         }
         else
         {
@@ -116,20 +121,17 @@ public:
         // istring.clear();
         // istring.shrink_to_fit();
 
-        read_samples(filename + ".ssa", this->r, n, samples_start);
-        read_samples(filename + ".esa", this->r, n, this->samples_last);
-
-        std::chrono::high_resolution_clock::time_point t_insert_end = std::chrono::high_resolution_clock::now();
-
-        verbose("R-index construction complete");
-        verbose("Memory peak: ", malloc_count_peak());
-        verbose("Elapsed time (s): ", std::chrono::duration<double, std::ratio<1>>(t_insert_end - t_insert_start).count());
-
-        verbose("Reading thresholds from file");
-
-        t_insert_start = std::chrono::high_resolution_clock::now();
-
-        thresholds = thresholds_t(filename,&this->bwt);
+        // The samples and the thresholds are independent once the BWT is built.
+        // The threads are split among the tasks, so that the workers of
+        // read_samples and of the thresholds are at most threads in total;
+        // the thresholds take the threads left by the other tasks.
+        const size_t n_tasks = tasks.size() + 3;
+        const size_t share = std::max((size_t)1, threads / n_tasks);
+        const size_t thr_threads = std::max((size_t)1, threads - std::min(threads, (n_tasks - 1) * share));
+        tasks.push_back([&]() { read_samples(filename + ".ssa", this->r, n, samples_start, share); });
+        tasks.push_back([&]() { read_samples(filename + ".esa", this->r, n, this->samples_last, share); });
+        tasks.push_back([&]() { thresholds = thresholds_t(filename, &this->bwt, thr_threads); });
+        run_tasks(tasks, threads);
 
         // std::string tmp_filename = filename + std::string(".thr_pos");
 
@@ -155,48 +157,49 @@ public:
 
         // fclose(fd);
 
-        t_insert_end = std::chrono::high_resolution_clock::now();
+        std::chrono::high_resolution_clock::time_point t_insert_end = std::chrono::high_resolution_clock::now();
 
+        verbose("R-index and thresholds construction complete");
         verbose("Memory peak: ", malloc_count_peak());
         verbose("Elapsed time (s): ", std::chrono::duration<double, std::ratio<1>>(t_insert_end - t_insert_start).count());
     }
 
-    void read_samples(std::string filename, ulint r, ulint n, int_vector<> &samples)
+    // Reads the samples in blocks of consecutive samples, one per thread. The
+    // blocks are multiples of 64 samples, so that no two threads write the
+    // same word of the int_vector.
+    void read_samples(std::string filename, ulint r, ulint n, int_vector<> &samples, size_t threads = 1)
     {
         int log_n = bitsize(uint64_t(n));
 
-        struct stat filestat;
-        FILE *fd;
-
-        if ((fd = fopen(filename.c_str(), "r")) == nullptr)
-            error("open() file " + filename + " failed");
-
-        int fn = fileno(fd);
-        if (fstat(fn, &filestat) < 0)
-            error("stat() file " + filename + " failed");
-
-        if (filestat.st_size % SSABYTES != 0)
+        // Each sample is a pair of integers
+        packed_reader<SSABYTES> reader(filename);
+        if (reader.size() % 2 != 0)
             error("invilid file " + filename);
 
-        size_t length = filestat.st_size / (2 * SSABYTES);
+        size_t length = reader.size() / 2;
         //Check that the length of the file is 2*r elements of 5 bytes
         assert(length == r);
 
         // Create the vector
-        samples = int_vector<>(r, 0, log_n);
-
-        // Read the vector
-        uint64_t left = 0;
-        uint64_t right = 0;
-        size_t i = 0;
-        while (fread((char *)&left, SSABYTES, 1, fd) && fread((char *)&right, SSABYTES, 1, fd))
-        {
-            ulint val = (right ? right - 1 : n - 1);
-            assert(bitsize(uint64_t(val)) <= log_n);
-            samples[i++] = val;
-        }
-
-        fclose(fd);
+        samples = int_vector<>(length, 0, log_n);
+
+        const size_t n_blocks = std::max((size_t)1, std::min(threads, (length + 63) / 64));
+        const size_t block_size = (((length + n_blocks - 1) / n_blocks + 63) / 64) * 64;
+
+        std::vector<std::function<void()>> tasks;
+        for (size_t begin = 0; begin < length; begin += block_size)
+            tasks.push_back([&, begin]() {
+                const size_t end = std::min(begin + block_size, length);
+                // Read the vector
+                reader.for_each(2 * begin, 2 * end, [&](size_t i, uint64_t right) {
+                    if (i % 2 == 0)
+                        return;
+                    ulint val = (right ? right - 1 : n - 1);
+                    assert(bitsize(uint64_t(val)) <= log_n);
+                    samples[i / 2] = val;
+                });
+            });
+        run_tasks(tasks, threads);
     }
 
     vector<ulint> build_F_(std::ifstream &heads, std::ifstream &lengths)
@@ -207,20 +210,26 @@ public:
         lengths.seekg(0);
 
         this->F = vector<ulint>(256, 0);
-        int c;
+        const size_t block = 1 << 16; // Runs read at a time
+        std::vector<uint64_t> run_heads(block);
+        std::vector<uint64_t> run_lengths(block);
+        size_t m;
         ulint i = 0;
-        while ((c = heads.get()) != EOF)
+        while ((m = read_packed<1>(heads, run_heads.data(), block)) > 0)
         {
-            size_t length = 0;
-            lengths.read((char *)&length, 5);
-            if (c > TERMINATOR)
-                this->F[c] += length;
-            else
+            if (read_packed<SSABYTES>(lengths, run_lengths.data(), m) != m)
+                error("The run heads and the run lengths do not match");
+            for (size_t j = 0; j < m; ++j, ++i)
             {
-                this->F[TERMINATOR] += length;
-                this->terminator_position = i;
+                const uint8_t c = run_heads[j];
+                if (c > TERMINATOR)
+                    this->F[c] += run_lengths[j];
+                else
+                {
+                    this->F[TERMINATOR] += run_lengths[j];
+                    this->terminator_position = i;
+                }
             }
-            i++;
         }
         for (ulint i = 255; i > 0; --i)
             this->F[i] = this->F[i - 1];
@@ -395,6 +404,65 @@ protected:
 
         return ms_pointers;
     }
+
+    // Computes the matching statistics pointers for the given pattern, with
+    // thresholds that count the thresholds of a letter before a position.
+    template <typename string_t>
+    std::vector<size_t> _query_thr_rank(const string_t &pattern, const size_t m)
+    {
+
+        std::vector<size_t> ms_pointers(m);
+
+        // Start with the empty string
+        auto pos = this->bwt_size() - 1;
+        auto sample = this->get_last_run_sample();
+
+        for (size_t i = 0; i < m; ++i)
+        {
+            auto c = pattern[m - i - 1];
+            const auto n_c = this->bwt.number_of_letter(c);
+            if (n_c == 0)
+            {
+                sample = 0;
+                // Perform one backward step
+                pos = LF(pos, c);
+            }
+            else if (pos < this->bwt.size() && this->bwt[pos] == c)
+            {
+                sample--;
+                // Perform one backward step
+                pos = LF(pos, c);
+            }
+            else
+            {
+                // Get threshold
+                ri::ulint run_of_pos = this->bwt.run_of_position(pos);
+                auto rnk_c = this->bwt.run_and_head_rank(run_of_pos, c);
+                size_t thr_c = thresholds.rank(pos + 1, c); // +1 because the rank count the thresiold in pos
+
+                if (rnk_c.first > thr_c)
+                {
+                    // Jump up
+                    size_t run_of_j = this->bwt.run_head_select(rnk_c.first, c);
+                    sample = this->samples_last[run_of_j];
+                    // Perform one backward step
+                    pos = this->F[c] + rnk_c.second - 1;
+                }
+                else
+                {
+                    // Jump down
+                    size_t run_of_j = this->bwt.run_head_select(rnk_c.first + 1, c);
+                    sample = samples_start[run_of_j];
+                    // Perform one backward step
+                    pos = this->F[c] + rnk_c.second;
+                }
+            }
+            // Store the sample
+            ms_pointers[m - i - 1] = sample;
+        }
+
+        return ms_pointers;
+    }
     // // From r-index
     // vector<ulint> build_F(std::ifstream &ifs)
     // {
@@ -457,6 +525,93 @@ protected:
 template <>
 template <typename string_t>
 std::vector<size_t> ms_pointers<ri::sparse_sd_vector, ms_rle_string_sd, thr_bv<ms_rle_string_sd>>::_query(const string_t &pattern, const size_t m)
+{
+    return _query_thr_rank(pattern, m);
+}
+
+// Computes the matching statistics pointers for the given pattern
+template <>
+template <typename string_t>
+std::vector<size_t> ms_pointers<ri::sparse_sd_vector, ms_rle_string_sd, thr_bv_compact<ms_rle_string_sd>>::_query(const string_t &pattern, const size_t m)
+{
+    return _query_thr_rank(pattern, m);
+}
+
+// Computes the matching statistics pointers for the given pattern. The first
+// position of the next run of c's is the start of its run, so the threshold is
+// read without selects on the BWT.
+template <>
+template <typename string_t>
+std::vector<size_t> ms_pointers<ri::sparse_sd_vector, ms_rle_string_sd, thr_relative<ms_rle_string_sd>>::_query(const string_t &pattern, const size_t m)
+{
+
+    std::vector<size_t> ms_pointers(m);
+
+    // Start with the empty string
+    auto pos = this->bwt_size() - 1;
+    auto sample = this->get_last_run_sample();
+
+    for (size_t i = 0; i < m; ++i)
+    {
+        auto c = pattern[m - i - 1];
+
+        if (this->bwt.number_of_letter(c) == 0)
+        {
+            sample = 0;
+        }
+        else if (pos < this->bwt.size() && this->bwt[pos] == c)
+        {
+            sample--;
+        }
+        else
+        {
+            // Get threshold
+            ri::ulint rnk = this->bwt.rank(pos, c);
+            size_t thr = this->bwt.size() + 1;
+
+            ulint next_pos = pos;
+
+            if (rnk < this->bwt.number_of_letter(c))
+            {
+                // j is the first position of the next run of c's
+                ri::ulint j = this->bwt.select(rnk, c);
+                ri::ulint run_of_j = this->bwt.run_of_position(j);
+
+                thr = thresholds.threshold(run_of_j, j); // If it is the first run thr = 0
+
+                sample = samples_start[run_of_j];
+
+                next_pos = j;
+            }
+
+            if (pos < thr)
+            {
+
+                rnk--;
+                ri::ulint j = this->bwt.select(rnk, c);
+                ri::ulint run_of_j = this->bwt.run_of_position(j);
+                sample = this->samples_last[run_of_j];
+
+                next_pos = j;
+            }
+
+            pos = next_pos;
+        }
+
+        ms_pointers[m - i - 1] = sample;
+
+        // Perform one backward step
+        pos = LF(pos, c);
+    }
+
+    return ms_pointers;
+}
+
+// Computes the matching statistics pointers for the given pattern. The
+// direction of the jump is read from the code of c in the run of pos.
+template <>
+template <typename string_t>
+std::vector<size_t> ms_pointers<ri::sparse_sd_vector, ms_rle_string_sd, thr_fused<ms_rle_string_sd>>::_query(const string_t &pattern, const size_t m)
 {
 
     std::vector<size_t> ms_pointers(m);
@@ -483,16 +638,14 @@ std::vector<size_t> ms_pointers<ri::sparse_sd_vector, ms_rle_string_sd, thr_bv<m
         }
         else
         {
-            // Get threshold
             ri::ulint run_of_pos = this->bwt.run_of_position(pos);
             auto rnk_c = this->bwt.run_and_head_rank(run_of_pos, c);
-            size_t thr_c = thresholds.rank(pos + 1, c); // +1 because the rank count the thresiold in pos
 
-            if (rnk_c.first > thr_c)
+            if (thresholds.jump_up(run_of_pos, pos, c))
             {
                 // Jump up
                 size_t run_of_j = this->bwt.run_head_select(rnk_c.first, c);
-                sample = samples_last[run_of_j];
+                sample = this->samples_last[run_of_j];
                 // Perform one backward step
                 pos = this->F[c] + rnk_c.second - 1;
             }
@@ -28,6 +28,48 @@
 
 #include <rle_string.hpp>
 
+#include <sdsl/sd_vector.hpp>
+
+// Access to the private members of ri::sparse_sd_vector. The names of private
+// members can be used in the arguments of an explicit instantiation, so the
+// pointers to them are taken there and returned by the friend get(tag).
+template <typename tag, typename tag::type member>
+struct sparse_sd_vector_access
+{
+    friend typename tag::type get(tag) { return member; }
+};
+
+#define SPARSE_SD_VECTOR_MEMBER(name, member_t)                                    \
+    struct sparse_sd_vector_##name                                                 \
+    {                                                                              \
+        typedef member_t ri::sparse_sd_vector::*type;                              \
+        friend type get(sparse_sd_vector_##name);                                  \
+    };                                                                             \
+    template struct sparse_sd_vector_access<sparse_sd_vector_##name, &ri::sparse_sd_vector::name>;
+
+SPARSE_SD_VECTOR_MEMBER(u, ri::ulint)
+SPARSE_SD_VECTOR_MEMBER(sdv, sdsl::sd_vector<>)
+SPARSE_SD_VECTOR_MEMBER(rank1, sdsl::sd_vector<>::rank_1_type)
+SPARSE_SD_VECTOR_MEMBER(select1, sdsl::sd_vector<>::select_1_type)
+
+#undef SPARSE_SD_VECTOR_MEMBER
+
+// Builds in res the sparse_sd_vector of universe u with the ones set in
+// builder. The sd_vector takes the vectors of the builder, and is swapped in
+// res, so nothing is copied and each vector is held once.
+inline void sparse_sd_vector_from_builder(sdsl::sd_vector_builder &builder, const ri::ulint u, ri::sparse_sd_vector &res)
+{
+    if (u == 0)
+        return;
+
+    sdsl::sd_vector<> sdv(builder);
+    auto &res_sdv = res.*get(sparse_sd_vector_sdv());
+    res_sdv.swap(sdv);
+    res.*get(sparse_sd_vector_u()) = u;
+    res.*get(sparse_sd_vector_rank1()) = sdsl::sd_vector<>::rank_1_type(&res_sdv);
+    res.*get(sparse_sd_vector_select1()) = sdsl::sd_vector<>::select_1_type(&res_sdv);
+}
+
 template <
     class sparse_bitvector_t = ri::sparse_sd_vector, //predecessor structure storing run length
     class string_t = ri::huff_string                 //run heads
@@ -55,8 +97,9 @@ public:
     {
     }
 
-    // Construction from run-length encoded BWT
-    ms_rle_string(std::ifstream &heads, std::ifstream &lengths, ulint B = 2)
+    // Construction from run-length encoded BWT. The threads are used only by
+    // the sparse_sd_vector specialization.
+    ms_rle_string(std::ifstream &heads, std::ifstream &lengths, ulint B = 2, size_t threads = 1)
     {
         // build_rlbwt(heads,lengths,B);
         heads.clear();
@@ -241,9 +284,14 @@ protected:
 private:
 };
 
-// Construction from run-length encoded BWT specialization for sparse_sd_vector
+// Construction from run-length encoded BWT specialization for sparse_sd_vector.
+// The run lengths are streamed twice: the first pass counts the runs and the
+// characters of each letter, the second pass sets the ones in sd_vector
+// builders of that size. Besides the run heads, the memory stays close to the
+// size of the structures built. The sparse bitvectors and the run heads are
+// finalized concurrently, each by its own task.
 template <>
-ms_rle_string<ri::sparse_sd_vector, ri::huff_string>::ms_rle_string(std::ifstream &heads, std::ifstream &lengths, ulint B)
+inline ms_rle_string<ri::sparse_sd_vector, ri::huff_string>::ms_rle_string(std::ifstream &heads, std::ifstream &lengths, ulint B, size_t threads)
 {
     heads.clear();
     heads.seekg(0);
@@ -260,45 +308,86 @@ ms_rle_string<ri::sparse_sd_vector, ri::huff_string>::ms_rle_string(std::ifstrea
     heads.seekg(0, heads.beg);
     heads.read(&run_heads_s[0], run_heads_s.size());
 
-    size_t pos = 0;
     this->n = 0;
     this->R = run_heads_s.size();
 
-    auto runs_per_letter_bv = vector<vector<size_t>> (256);
-    auto runs_per_letter_bv_i = vector<size_t> (256,0);
-    //runs in main bitvector
-    vector<size_t> runs_bv_onset;
-    size_t runs_bv_i = 0;
-    // Compute runs_bv and runs_per_letter_bv
+    // Calls f(i, c, length) for each run i, reading the run lengths in blocks
+    auto for_each_run = [&](auto f) {
+        lengths.clear();
+        lengths.seekg(0);
+        const size_t block = 1 << 16; // Runs read at a time
+        std::vector<uint64_t> run_lengths(block);
+        for (size_t i = 0; i < this->R; i += block)
+        {
+            const size_t m = std::min(block, (size_t)this->R - i);
+            if (read_packed<SSABYTES>(lengths, run_lengths.data(), m) != m)
+                error("The run heads and the run lengths do not match");
+            for (size_t j = 0; j < m; ++j)
+            {
+                assert(run_lengths[j] > 0);
+                f(i + j, (uint8_t)run_heads_s[i + j], run_lengths[j]);
+            }
+        }
+    };
+
+    // Count the runs and the characters of each letter
     for (size_t i = 0; i < run_heads_s.size(); ++i)
-    {
-        size_t length = 0;
-        lengths.read((char *)&length, 5);
         if (run_heads_s[i] <= TERMINATOR) // change 0 to 1
             run_heads_s[i] = TERMINATOR;
 
-        if(i % B == B - 1)
-            runs_bv_onset.push_back(this->n + length - 1);
-
-        assert(length > 0);
-        runs_per_letter_bv_i[run_heads_s[i]] += length;
-        runs_per_letter_bv[run_heads_s[i]].push_back(runs_per_letter_bv_i[run_heads_s[i]] - 1);
-
+    auto runs_per_letter_i = vector<size_t>(256, 0);
+    auto runs_per_letter_bv_i = vector<size_t>(256, 0);
+    for_each_run([&](size_t i, uint8_t c, size_t length) {
+        runs_per_letter_i[c]++;
+        runs_per_letter_bv_i[c] += length;
         this->n += length;
-    }
-    // runs_bv.push_back(false);
+    });
 
-    //now compact structures
     ulint t = 0;
     for (ulint i = 0; i < 256; ++i)
         t += runs_per_letter_bv_i[i];
     assert(t == this->n);
-    this->runs = ri::sparse_sd_vector(runs_bv_onset, this->n);
+
+    // Compute runs_bv and runs_per_letter_bv
+    sdsl::sd_vector_builder runs_bv(this->n, this->R / B);
+    auto runs_per_letter_bv = vector<sdsl::sd_vector_builder>(256);
+    for (ulint i = 0; i < 256; ++i)
+        if (runs_per_letter_i[i] > 0)
+            runs_per_letter_bv[i] = sdsl::sd_vector_builder(runs_per_letter_bv_i[i], runs_per_letter_i[i]);
+
+    size_t pos = 0;
+    auto runs_per_letter_pos = vector<size_t>(256, 0);
+    for_each_run([&](size_t i, uint8_t c, size_t length) {
+        if (i % B == B - 1)
+            runs_bv.set(pos + length - 1);
+
+        runs_per_letter_pos[c] += length;
+        runs_per_letter_bv[c].set(runs_per_letter_pos[c] - 1);
+
+        pos += length;
+    });
+
+    //now compact structures
     //a fast direct array: char -> bitvector.
     this->runs_per_letter = vector<ri::sparse_sd_vector>(256);
+
+    std::vector<std::function<void()>> tasks;
+    // The huff_string is built through the sdsl RAM file system, hence by one
+    // task only.
+    tasks.push_back([&]() { this->run_heads = ri::huff_string(run_heads_s); });
+    tasks.push_back([&]() { sparse_sd_vector_from_builder(runs_bv, this->n, this->runs); });
+    // Only the letters that occur have a bitvector to build. They are started
+    // from the one with the most runs, so the longest tasks do not end last.
+    std::vector<uint8_t> letters;
     for (ulint i = 0; i < 256; ++i)
-        this->runs_per_letter[i] = ri::sparse_sd_vector(runs_per_letter_bv[i],runs_per_letter_bv_i[i]);
-    this->run_heads = ri::huff_string(run_heads_s);
+        if (runs_per_letter_i[i] > 0)
+            letters.push_back(i);
+    std::stable_sort(letters.begin(), letters.end(), [&](uint8_t a, uint8_t b) { return runs_per_letter_i[a] > runs_per_letter_i[b]; });
+    for (auto i : letters)
+        tasks.push_back([&, i]() {
+            sparse_sd_vector_from_builder(runs_per_letter_bv[i], runs_per_letter_bv_i[i], this->runs_per_letter[i]);
+        });
+    run_tasks(tasks, threads);
     assert(this->run_heads.size() == this->R);
 };
 
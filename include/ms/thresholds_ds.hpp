@@ -31,6 +31,9 @@
 #include <sdsl/rmq_support.hpp>
 #include <sdsl/int_vector.hpp>
 
+#include <limits>
+#include <array>
+
 #include <ms_rle_string.hpp>
 
 template <class rle_string_t = ms_rle_string_sd>
@@ -47,7 +50,8 @@ public:
         bwt=nullptr;
     }
 
-    thr_plain(std::string filename, rle_string_t* bwt_):bwt(bwt_)
+    // The thresholds are read sequentially, threads is not used
+    thr_plain(std::string filename, rle_string_t* bwt_, size_t threads = 1):bwt(bwt_)
     {
         int log_n = bitsize(uint64_t(bwt->size()));
 
@@ -57,33 +61,14 @@ public:
 
         std::string tmp_filename = filename + std::string(".thr_pos");
 
-        struct stat filestat;
-        FILE *fd;
-
-        if ((fd = fopen(tmp_filename.c_str(), "r")) == nullptr)
-            error("open() file " + tmp_filename + " failed");
-
-        int fn = fileno(fd);
-        if (fstat(fn, &filestat) < 0)
-            error("stat() file " + tmp_filename + " failed");
-
-        if (filestat.st_size % THRBYTES != 0)
-            error("invilid file " + tmp_filename);
-
-        size_t length = filestat.st_size / THRBYTES;
-        size_t threshold = 0;
+        packed_reader<THRBYTES> reader(tmp_filename);
+        size_t length = reader.size();
 
         thresholds = int_vector<>(length, 0, log_n);
 
-        for (size_t i = 0; i < length; ++i)
-        {
-            size_t threshold = 0;
-            if ((fread(&threshold, THRBYTES, 1, fd)) != 1)
-                error("fread() file " + tmp_filename + " failed");
+        reader.for_each([&](size_t i, uint64_t threshold) {
             thresholds[i] = threshold;
-        }
-
-        fclose(fd);
+        });
 
         std::chrono::high_resolution_clock::time_point t_insert_end = std::chrono::high_resolution_clock::now();
 
@@ -177,7 +162,11 @@ public:
         bwt=nullptr;
     }
 
-    thr_compressed(std::string filename, rle_string_t* bwt_):bwt(bwt_)
+    // The thresholds are read in one pass over the runs, in order. The
+    // predecessor of each run is the last position of its letter seen so far,
+    // and the offsets are kept in a temporary int_vector shifted by n, that is
+    // compressed in place at the end. The threads are not used.
+    thr_compressed(std::string filename, rle_string_t* bwt_, size_t threads = 1):bwt(bwt_)
     {
         int log_n = bitsize(uint64_t(bwt->size()));
         size_t n = uint64_t(bwt->size());
@@ -188,38 +177,29 @@ public:
 
         std::string tmp_filename = filename + std::string(".thr_pos");
 
-        struct stat filestat;
-        FILE *fd;
-
-        if ((fd = fopen(tmp_filename.c_str(), "r")) == nullptr)
-            error("open() file " + tmp_filename + " failed");
-
-        int fn = fileno(fd);
-        if (fstat(fn, &filestat) < 0)
-            error("stat() file " + tmp_filename + " failed");
-
-        if (filestat.st_size % THRBYTES != 0)
-            error("invilid file " + tmp_filename);
-
-        size_t length = filestat.st_size / THRBYTES;
+        packed_reader<THRBYTES> reader(tmp_filename);
+        size_t length = reader.size();
 
         size_t pos = 0;
 
+        // The offsets of the runs without threshold are 0
         long long max_off = 0;
-        min_off = n;
+        min_off = 0;
 
-        for (size_t i = 0; i < length; ++i)
-        {
-            size_t threshold = 0;
-            if ((fread(&threshold, THRBYTES, 1, fd)) != 1)
-                error("fread() file " + tmp_filename + " failed");
+        // Last position of each letter before the current run
+        std::vector<size_t> last(256, 0);
+        std::vector<bool> seen(256, false);
 
+        // The offsets are in (-n..n]
+        int_vector<> offsets(length, 0, bitsize(uint64_t(2 * n + 1)));
+        reader.for_each([&](size_t i, uint64_t threshold) {
             long long off = 0;
 
+            uint8_t c = bwt->head_of(i);
             if (threshold > 0)
             {
-                uint8_t c = bwt->head_of(i);
-                size_t pred = bwt->select(bwt->rank(pos - 1, c) - 1, c);
+                assert(seen[c]);
+                size_t pred = last[c];
                 size_t mid_int = (pos - pred + 1) >> 1;
                 assert(threshold > pred);
 
@@ -231,44 +211,17 @@ public:
                 min_off = min(min_off, off);
             }
 
+            offsets[i] = off + (long long)n;
             pos += bwt->run_at(i);
-        }
-
-        // Rewind the file
-        fseek(fd,0, SEEK_SET);
-        pos = 0;
-        
-        int log_off = bitsize((size_t)(max_off - min_off + 1));
+            last[c] = pos - 1;
+            seen[c] = true;
+        });
 
         min_off = -min_off; // Shift all the values
-        thresholds = int_vector<>(length,0,log_off);
         for (size_t i = 0; i < length; ++i)
-        {
-            size_t threshold = 0;
-            if ((fread(&threshold, THRBYTES, 1, fd)) != 1)
-                error("fread() file " + tmp_filename + " failed");
-
-            long long off = 0;
-
-            if (threshold > 0)
-            {
-                uint8_t c = bwt->head_of(i);
-                size_t pred = bwt->select(bwt->rank(pos - 1, c) - 1, c);
-                size_t mid_int = (pos - pred + 1) >> 1;
-                assert(threshold > pred);
-
-                threshold = threshold - pred;
-
-                off = mid_int - threshold + min_off;
-            }
-
-            thresholds[i] = off;
-            pos += bwt->run_at(i);
-        }
-
-        fclose(fd);
-
-
+            offsets[i] = offsets[i] - n + min_off;
+        sdsl::util::bit_compress(offsets);
+        thresholds = std::move(offsets);
 
         std::chrono::high_resolution_clock::time_point t_insert_end = std::chrono::high_resolution_clock::now();
 
@@ -367,24 +320,31 @@ public:
 };
 
 
+// Thresholds stored as their distance from the start of their run, plus one,
+// in the width that minimizes the space. A distance that does not fit is
+// stored as 0 and kept in a table of exceptions, so a few long gaps do not
+// widen all the entries. The matching statistics query knows the start of
+// the run, so a threshold costs one access to the int_vector.
 template <class rle_string_t = ms_rle_string_sd>
-class thr_bv
+class thr_relative
 {
 public:
-    std::vector<ri::sparse_sd_vector> thresholds_per_letter;
+    int_vector<> deltas;     // Start of the run minus the threshold, plus one, or 0
+    int_vector<> exc_runs;   // Runs whose distance is an exception, in increasing order
+    int_vector<> exc_deltas; // Their distances
     rle_string_t *bwt;
 
     typedef size_t size_type;
 
-    thr_bv()
+    thr_relative()
     {
         bwt=nullptr;
     }
 
-    thr_bv(std::string filename, rle_string_t* bwt_):bwt(bwt_)
+    // The thresholds are read sequentially, threads is not used
+    thr_relative(std::string filename, rle_string_t* bwt_, size_t threads = 1):bwt(bwt_)
     {
         int log_n = bitsize(uint64_t(bwt->size()));
-        size_t n = uint64_t(bwt->size());
 
         verbose("Reading thresholds from file");
 
@@ -392,46 +352,199 @@ public:
 
         std::string tmp_filename = filename + std::string(".thr_pos");
 
-        struct stat filestat;
-        FILE *fd;
+        packed_reader<THRBYTES> reader(tmp_filename);
+        size_t length = reader.size();
+
+        auto width = [](const uint64_t x) { return (x == 0 ? 0 : 64 - __builtin_clzll(x)); };
+
+        // Distances plus one, and the number of them of each width
+        int_vector<> tmp(length, 0, log_n + 1);
+        std::vector<size_t> widths(65, 0);
+        size_t pos = 0;
+        reader.for_each([&](size_t i, uint64_t threshold) {
+            assert(threshold <= pos);
+            tmp[i] = pos - threshold + 1;
+            widths[width(pos - threshold + 1)]++;
+            pos += bwt->run_at(i);
+        });
+
+        // Width minimizing the entries plus the exceptions
+        const size_t exc_bits = bitsize(uint64_t(length)) + log_n;
+        size_t best_w = 64;
+        size_t best_bits = std::numeric_limits<size_t>::max();
+        size_t exceptions = length;
+        for (size_t w = 1; w <= 64; ++w)
+        {
+            exceptions -= widths[w];
+            const size_t bits = length * w + exceptions * exc_bits;
+            if (bits < best_bits)
+            {
+                best_bits = bits;
+                best_w = w;
+            }
+        }
 
-        if ((fd = fopen(tmp_filename.c_str(), "r")) == nullptr)
-            error("open() file " + tmp_filename + " failed");
+        size_t n_exc = 0;
+        for (size_t w = best_w + 1; w <= 64; ++w)
+            n_exc += widths[w];
 
-        int fn = fileno(fd);
-        if (fstat(fn, &filestat) < 0)
-            error("stat() file " + tmp_filename + " failed");
+        deltas = int_vector<>(length, 0, best_w);
+        exc_runs = int_vector<>(n_exc, 0, bitsize(uint64_t(length)));
+        exc_deltas = int_vector<>(n_exc, 0, log_n);
+        for (size_t i = 0, j = 0; i < length; ++i)
+        {
+            const uint64_t d = tmp[i];
+            if (width(d) <= best_w)
+                deltas[i] = d;
+            else
+            {
+                exc_runs[j] = i;
+                exc_deltas[j++] = d - 1;
+            }
+        }
 
-        if (filestat.st_size % THRBYTES != 0)
-            error("invilid file " + tmp_filename);
+        verbose("Thresholds width: ", best_w, " exceptions: ", n_exc);
 
-        size_t length = filestat.st_size / THRBYTES;
+        std::chrono::high_resolution_clock::time_point t_insert_end = std::chrono::high_resolution_clock::now();
 
-        auto thrs_per_letter_bv = vector<vector<size_t>>(256);
-        auto thrs_per_letter_bv_i = vector<size_t>(256, 0);
+        verbose("Memory peak: ", malloc_count_peak());
+        verbose("Elapsed time (s): ", std::chrono::duration<double, std::ratio<1>>(t_insert_end - t_insert_start).count());
+    }
 
-        for (size_t i = 0; i < length; ++i)
-        {
-            size_t threshold = 0;
-            if ((fread(&threshold, THRBYTES, 1, fd)) != 1)
-                error("fread() file " + tmp_filename + " failed");
+    // Destructor
+    ~thr_relative()
+    {
+        // NtD
+    }
 
-            long long off = 0;
+    // Copy constructor
+    thr_relative(const thr_relative &other)
+        : deltas(other.deltas),
+          exc_runs(other.exc_runs),
+          exc_deltas(other.exc_deltas),
+          bwt(other.bwt)
+    {
+    }
 
-            uint8_t c = bwt->head_of(i);
-            if (threshold > 0)
-                thrs_per_letter_bv[c].push_back(threshold);
-            thrs_per_letter_bv_i[c] = n;
+    friend void swap(thr_relative &first, thr_relative &second) // nothrow
+    {
+        using std::swap;
 
+        swap(first.deltas, second.deltas);
+        swap(first.exc_runs, second.exc_runs);
+        swap(first.exc_deltas, second.exc_deltas);
+        swap(first.bwt, second.bwt);
+    }
+
+    // Copy assignment
+    thr_relative &operator=(thr_relative other)
+    {
+        swap(*this, other);
+
+        return *this;
+    }
+
+    // Move constructor
+    thr_relative(thr_relative &&other) noexcept
+        : thr_relative()
+    {
+        swap(*this, other);
+    }
+
+    // Threshold of the i-th run, that starts at position start
+    inline size_t threshold(const size_t i, const size_t start) const
+    {
+        assert(i < deltas.size());
+        const size_t d = deltas[i];
+        if (d > 0)
+            return start - (d - 1);
+
+        // Binary search of the exception
+        size_t l = 0, r = exc_runs.size();
+        while (l < r)
+        {
+            size_t m = (l + r) / 2;
+            if (exc_runs[m] < i)
+                l = m + 1;
+            else
+                r = m;
         }
+        assert(l < exc_runs.size() and exc_runs[l] == i);
+        return start - exc_deltas[l];
+    }
 
-        thresholds_per_letter = vector<ri::sparse_sd_vector>(256);
-        for (ulint i = 0; i < 256; ++i)
-            thresholds_per_letter[i] = ri::sparse_sd_vector(thrs_per_letter_bv[i], thrs_per_letter_bv_i[i]);
+    size_t operator[] (size_t& i)
+    {
+        assert(i < bwt->number_of_runs());
+        return threshold(i, bwt->run_range(i).first);
+    }
 
-        fclose(fd);
+    /* serialize the structure to the ostream
+     * \param out     the ostream
+     */
+    size_type serialize(std::ostream &out, sdsl::structure_tree_node *v = nullptr, std::string name = "") // const
+    {
+        sdsl::structure_tree_node *child = sdsl::structure_tree::add_child(v, name, sdsl::util::class_name(*this));
+        size_type written_bytes = 0;
 
+        written_bytes += deltas.serialize(out, child, "deltas");
+        written_bytes += exc_runs.serialize(out, child, "exc_runs");
+        written_bytes += exc_deltas.serialize(out, child, "exc_deltas");
 
+        sdsl::structure_tree::add_size(child, written_bytes);
+        return written_bytes;
+    }
+
+    /* load the structure from the istream
+     * \param in the istream
+     */
+    void load(std::istream &in, rle_string_t *bwt_)
+    {
+        deltas.load(in);
+        exc_runs.load(in);
+        exc_deltas.load(in);
+        bwt = bwt_;
+    }
+
+    std::string get_file_extension() const
+    {
+        return ".thrr";
+    }
+};
+
+template <class rle_string_t = ms_rle_string_sd>
+class thr_bv
+{
+public:
+    std::vector<ri::sparse_sd_vector> thresholds_per_letter;
+    rle_string_t *bwt;
+
+    typedef size_t size_type;
+
+    thr_bv()
+    {
+        bwt=nullptr;
+    }
+
+    // The 256 sparse bitvectors are built concurrently.
+    thr_bv(std::string filename, rle_string_t* bwt_, size_t threads = 1):bwt(bwt_)
+    {
+        verbose("Reading thresholds from file");
+
+        std::chrono::high_resolution_clock::time_point t_insert_start = std::chrono::high_resolution_clock::now();
+
+        vector<vector<size_t>> thrs_per_letter_bv;
+        vector<size_t> thrs_per_letter_bv_i;
+        read_thresholds(filename, bwt, thrs_per_letter_bv, thrs_per_letter_bv_i, threads);
+
+        thresholds_per_letter = vector<ri::sparse_sd_vector>(256);
+        std::vector<std::function<void()>> tasks;
+        for (ulint i = 0; i < 256; ++i)
+            tasks.push_back([&, i]() {
+                thresholds_per_letter[i] = ri::sparse_sd_vector(thrs_per_letter_bv[i], thrs_per_letter_bv_i[i]);
+                vector<size_t>().swap(thrs_per_letter_bv[i]);
+            });
+        run_tasks(tasks, threads);
 
         std::chrono::high_resolution_clock::time_point t_insert_end = std::chrono::high_resolution_clock::now();
 
@@ -439,6 +552,68 @@ public:
         verbose("Elapsed time (s): ", std::chrono::duration<double, std::ratio<1>>(t_insert_end - t_insert_start).count());
     }
 
+    // Reads the thresholds of each letter of the BWT, in increasing order, and
+    // the length of the bitvector of each letter, that is the length of the
+    // BWT if the letter occurs and 0 otherwise. The thresholds are split in
+    // blocks of consecutive runs, one per thread. A first pass counts the
+    // thresholds of each letter in each block, and a second pass writes them at
+    // the offset of the block.
+    static void read_thresholds(std::string filename, rle_string_t *bwt, vector<vector<size_t>> &thrs_per_letter_bv, vector<size_t> &thrs_per_letter_bv_i, size_t threads = 1)
+    {
+        size_t n = uint64_t(bwt->size());
+
+        std::string tmp_filename = filename + std::string(".thr_pos");
+
+        packed_reader<THRBYTES> reader(tmp_filename);
+        size_t length = reader.size();
+
+        const size_t n_blocks = std::max((size_t)1, std::min(threads, length));
+        auto block_begin = [&](const size_t b) { return (length * b) / n_blocks; };
+
+        // Thresholds of each letter in each block, and whether the letter occurs
+        auto block_thrs = vector<vector<size_t>>(n_blocks, vector<size_t>(256, 0));
+        auto block_occs = vector<vector<bool>>(n_blocks, vector<bool>(256, false));
+
+        std::vector<std::function<void()>> tasks;
+        for (size_t b = 0; b < n_blocks; ++b)
+            tasks.push_back([&, b]() {
+                reader.for_each(block_begin(b), block_begin(b + 1), [&](size_t i, uint64_t threshold) {
+                    uint8_t c = bwt->head_of(i);
+                    if (threshold > 0)
+                        block_thrs[b][c]++;
+                    block_occs[b][c] = true;
+                });
+            });
+        run_tasks(tasks, threads);
+
+        thrs_per_letter_bv = vector<vector<size_t>>(256);
+        thrs_per_letter_bv_i = vector<size_t>(256, 0);
+
+        // Turns the counts into the offsets of the blocks
+        auto letter_thrs = vector<size_t>(256, 0);
+        for (size_t b = 0; b < n_blocks; ++b)
+            for (size_t c = 0; c < 256; ++c)
+            {
+                std::swap(block_thrs[b][c], letter_thrs[c]);
+                letter_thrs[c] += block_thrs[b][c];
+                if (block_occs[b][c])
+                    thrs_per_letter_bv_i[c] = n;
+            }
+        for (size_t c = 0; c < 256; ++c)
+            thrs_per_letter_bv[c].resize(letter_thrs[c]);
+
+        tasks.clear();
+        for (size_t b = 0; b < n_blocks; ++b)
+            tasks.push_back([&, b]() {
+                reader.for_each(block_begin(b), block_begin(b + 1), [&](size_t i, uint64_t threshold) {
+                    uint8_t c = bwt->head_of(i);
+                    if (threshold > 0)
+                        thrs_per_letter_bv[c][block_thrs[b][c]++] = threshold;
+                });
+            });
+        run_tasks(tasks, threads);
+    }
+
     // Destructor
     ~thr_bv()
     {
@@ -528,4 +703,360 @@ public:
     }
 };
 
+// thr_bv restricted to the letters that occur in the BWT. The letters are
+// mapped to dense indices, and only their sparse bitvectors are stored,
+// contiguously. The letters that do not occur share one empty bitvector.
+template <class rle_string_t = ms_rle_string_sd>
+class thr_bv_compact
+{
+public:
+    std::array<uint8_t, 256> letters;                   // Dense index of each letter
+    std::vector<ri::sparse_sd_vector> thresholds_per_letter; // One per dense index
+    rle_string_t *bwt;
+
+    typedef size_t size_type;
+
+    thr_bv_compact()
+    {
+        letters.fill(0);
+        bwt=nullptr;
+    }
+
+    // Only the bitvectors of the letters that occur are built, concurrently.
+    thr_bv_compact(std::string filename, rle_string_t* bwt_, size_t threads = 1):bwt(bwt_)
+    {
+        verbose("Reading thresholds from file");
+
+        std::chrono::high_resolution_clock::time_point t_insert_start = std::chrono::high_resolution_clock::now();
+
+        vector<vector<size_t>> thrs_per_letter_bv;
+        vector<size_t> thrs_per_letter_bv_i;
+        thr_bv<rle_string_t>::read_thresholds(filename, bwt, thrs_per_letter_bv, thrs_per_letter_bv_i, threads);
+
+        std::vector<uint8_t> present;
+        for (size_t c = 0; c < 256; ++c)
+            if (thrs_per_letter_bv_i[c] > 0)
+            {
+                letters[c] = present.size();
+                present.push_back(c);
+            }
+        const size_t sigma = present.size();
+
+        // The letters that do not occur are mapped to index sigma
+        for (size_t c = 0; c < 256; ++c)
+            if (thrs_per_letter_bv_i[c] == 0)
+                letters[c] = sigma;
+
+        thresholds_per_letter = vector<ri::sparse_sd_vector>(sigma + (sigma < 256));
+        std::vector<std::function<void()>> tasks;
+        for (size_t k = 0; k < sigma; ++k)
+            tasks.push_back([&, k]() {
+                const uint8_t c = present[k];
+                thresholds_per_letter[k] = ri::sparse_sd_vector(thrs_per_letter_bv[c], thrs_per_letter_bv_i[c]);
+                vector<size_t>().swap(thrs_per_letter_bv[c]);
+            });
+        run_tasks(tasks, threads);
+
+        verbose("Thresholds stored for ", sigma, " letters");
+
+        std::chrono::high_resolution_clock::time_point t_insert_end = std::chrono::high_resolution_clock::now();
+
+        verbose("Memory peak: ", malloc_count_peak());
+        verbose("Elapsed time (s): ", std::chrono::duration<double, std::ratio<1>>(t_insert_end - t_insert_start).count());
+    }
+
+    // Destructor
+    ~thr_bv_compact()
+    {
+        // NtD
+    }
+
+    // Copy constructor
+    thr_bv_compact(const thr_bv_compact &other)
+        : letters(other.letters),
+          thresholds_per_letter(other.thresholds_per_letter),
+          bwt(other.bwt)
+    {
+    }
+
+    friend void swap(thr_bv_compact &first, thr_bv_compact &second) // nothrow
+    {
+        using std::swap;
+
+        swap(first.letters, second.letters);
+        swap(first.thresholds_per_letter, second.thresholds_per_letter);
+        swap(first.bwt, second.bwt);
+    }
+
+    // Copy assignment
+    thr_bv_compact &operator=(thr_bv_compact other)
+    {
+        swap(*this, other);
+
+        return *this;
+    }
+
+    // Move constructor
+    thr_bv_compact(thr_bv_compact &&other) noexcept
+        : thr_bv_compact()
+    {
+        swap(*this, other);
+    }
+
+    size_t operator[] (size_t& i)
+    {
+        assert(i < bwt->number_of_runs());
+
+        // get mid_interval
+        uint8_t c = bwt->head_of(i);
+        size_t rank = bwt->run_head_rank(i, c);
+        if(rank == 0)
+            return 0;
+
+        return thresholds_per_letter[letters[c]].select(rank - 1);
+    }
+
+    // number of thresholds for the character c before position i
+    inline size_t rank(const size_t i, const uint8_t c)
+    {
+        return thresholds_per_letter[letters[c]].rank(i);
+    }
+
+    /* serialize the structure to the ostream
+     * \param out     the ostream
+     */
+    size_type serialize(std::ostream &out, sdsl::structure_tree_node *v = nullptr, std::string name = "") // const
+    {
+        sdsl::structure_tree_node *child = sdsl::structure_tree::add_child(v, name, sdsl::util::class_name(*this));
+        size_type written_bytes = 0;
+
+        // Header: the number of bitvectors and the map of the letters
+        size_t sigma = thresholds_per_letter.size();
+        out.write((char *)&sigma, sizeof(sigma));
+        written_bytes += sizeof(sigma);
+        out.write((char *)letters.data(), letters.size());
+        written_bytes += letters.size();
+
+        for (auto &bv : thresholds_per_letter)
+            written_bytes += bv.serialize(out);
+
+        sdsl::structure_tree::add_size(child, written_bytes);
+        return written_bytes;
+    }
+
+    /* load the structure from the istream
+     * \param in the istream
+     */
+    void load(std::istream &in, rle_string_t *bwt_)
+    {
+        size_t sigma = 0;
+        in.read((char *)&sigma, sizeof(sigma));
+        in.read((char *)letters.data(), letters.size());
+
+        thresholds_per_letter = vector<ri::sparse_sd_vector>(sigma);
+        for (auto &bv : thresholds_per_letter)
+            bv.load(in);
+        bwt = bwt_;
+    }
+
+    std::string get_file_extension() const
+    {
+        return ".thrbvc";
+    }
+};
+
+// Decision of the matching statistics query precomputed for each run and each
+// letter c that is not the head of the run: whether a position in the run
+// jumps up to the previous run of c, down to the next one, or is split by the
+// threshold of the next run of c. Only the split runs store the position of
+// the threshold. The query reads one 2-bit code instead of ranking the
+// thresholds of c, so it supports only the _query specialization of
+// ms_pointers and no access to the thresholds.
+template <class rle_string_t = ms_rle_string_sd>
+class thr_fused
+{
+public:
+    static constexpr uint8_t DOWN = 0;
+    static constexpr uint8_t UP = 1;
+    static constexpr uint8_t SPLIT = 2;
+
+    std::array<uint8_t, 256> letters; // Dense index of each letter
+    size_t sigma = 0;                 // Number of letters in the BWT
+    int_vector<2> codes;              // Code of letter c in run i at i * sigma + letters[c]
+    ri::sparse_sd_vector splits;      // Indices of the SPLIT codes
+    int_vector<> split_pos;           // Thresholds of the SPLIT codes
+    rle_string_t *bwt;
+
+    typedef size_t size_type;
+
+    thr_fused()
+    {
+        letters.fill(0);
+        bwt=nullptr;
+    }
+
+    thr_fused(std::string filename, rle_string_t* bwt_, size_t threads = 1):bwt(bwt_)
+    {
+        thr_bv<rle_string_t> thr(filename, bwt, threads);
+
+        verbose("Computing the jump codes of the runs");
+
+        std::chrono::high_resolution_clock::time_point t_insert_start = std::chrono::high_resolution_clock::now();
+
+        std::vector<uint8_t> present;
+        letters.fill(0);
+        for (size_t c = 0; c < 256; ++c)
+            if (bwt->number_of_letter(c) > 0)
+            {
+                letters[c] = present.size();
+                present.push_back(c);
+            }
+        sigma = present.size();
+
+        // The query jumps up from position p iff fewer than R thresholds of c
+        // are at most p, where R is the number of runs of c before p.
+        const size_t r = bwt->number_of_runs();
+        codes = int_vector<2>(r * sigma, DOWN);
+        std::vector<size_t> runs_of(256, 0);
+        std::vector<size_t> split_onset;
+        std::vector<size_t> split_thr;
+        size_t start = 0;
+        for (size_t i = 0; i < r; ++i)
+        {
+            const uint8_t h = bwt->head_of(i);
+            const size_t end = start + bwt->run_at(i) - 1;
+            for (uint8_t c : present)
+            {
+                const size_t R = runs_of[c];
+                if (c == h or R == 0)
+                    continue;
+
+                uint8_t code = UP;
+                if (R - 1 < thr.thresholds_per_letter[c].number_of_1())
+                {
+                    const size_t t = thr.thresholds_per_letter[c].select(R - 1);
+                    if (t <= start)
+                        code = DOWN;
+                    else if (t <= end)
+                    {
+                        code = SPLIT;
+                        split_onset.push_back(i * sigma + letters[c]);
+                        split_thr.push_back(t);
+                    }
+                }
+                codes[i * sigma + letters[c]] = code;
+            }
+            runs_of[h]++;
+            start = end + 1;
+        }
+
+        splits = ri::sparse_sd_vector(split_onset, r * sigma);
+        split_pos = int_vector<>(split_thr.size(), 0, bitsize(uint64_t(bwt->size())));
+        for (size_t i = 0; i < split_thr.size(); ++i)
+            split_pos[i] = split_thr[i];
+
+        verbose("Split codes: ", split_thr.size(), " of ", r * sigma);
+
+        std::chrono::high_resolution_clock::time_point t_insert_end = std::chrono::high_resolution_clock::now();
+
+        verbose("Memory peak: ", malloc_count_peak());
+        verbose("Elapsed time (s): ", std::chrono::duration<double, std::ratio<1>>(t_insert_end - t_insert_start).count());
+    }
+
+    // Destructor
+    ~thr_fused()
+    {
+        // NtD
+    }
+
+    // Copy constructor
+    thr_fused(const thr_fused &other)
+        : letters(other.letters),
+          sigma(other.sigma),
+          codes(other.codes),
+          splits(other.splits),
+          split_pos(other.split_pos),
+          bwt(other.bwt)
+    {
+    }
+
+    friend void swap(thr_fused &first, thr_fused &second) // nothrow
+    {
+        using std::swap;
+
+        swap(first.letters, second.letters);
+        swap(first.sigma, second.sigma);
+        swap(first.codes, second.codes);
+        swap(first.splits, second.splits);
+        swap(first.split_pos, second.split_pos);
+        swap(first.bwt, second.bwt);
+    }
+
+    // Copy assignment
+    thr_fused &operator=(thr_fused other)
+    {
+        swap(*this, other);
+
+        return *this;
+    }
+
+    // Move constructor
+    thr_fused(thr_fused &&other) noexcept
+        : thr_fused()
+    {
+        swap(*this, other);
+    }
+
+    // Whether position pos, in run i, jumps up to the previous run of c. The
+    // head of run i must differ from c.
+    inline bool jump_up(const size_t i, const size_t pos, const uint8_t c)
+    {
+        const size_t k = i * sigma + letters[c];
+        const uint8_t code = codes[k];
+        if (code != SPLIT)
+            return code == UP;
+        return pos < split_pos[splits.rank(k)];
+    }
+
+    /* serialize the structure to the ostream
+     * \param out     the ostream
+     */
+    size_type serialize(std::ostream &out, sdsl::structure_tree_node *v = nullptr, std::string name = "") // const
+    {
+        sdsl::structure_tree_node *child = sdsl::structure_tree::add_child(v, name, sdsl::util::class_name(*this));
+        size_type written_bytes = 0;
+
+        out.write((char *)&sigma, sizeof(sigma));
+        written_bytes += sizeof(sigma);
+        out.write((char *)letters.data(), letters.size());
+        written_bytes += letters.size();
+
+        written_bytes += codes.serialize(out, child, "codes");
+        written_bytes += splits.serialize(out);
+        written_bytes += split_pos.serialize(out, child, "split_pos");
+
+        sdsl::structure_tree::add_size(child, written_bytes);
+        return written_bytes;
+    }
+
+    /* load the structure from the istream
+     * \param in the istream
+     */
+    void load(std::istream &in, rle_string_t *bwt_)
+    {
+        in.read((char *)&sigma, sizeof(sigma));
+        in.read((char *)letters.data(), letters.size());
+
+        codes.load(in);
+        splits.load(in);
+        split_pos.load(in);
+        bwt = bwt_;
+    }
+
+    std::string get_file_extension() const
+    {
+        return ".thrf";
+    }
+};
+
 #endif /* end of include guard: _MS_THRESHOLDS_DS_HH */
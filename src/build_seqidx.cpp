@@ -42,6 +42,7 @@ struct Args
 {
   std::string filename = "";
   std::string outpath = ""; // path where to output the file
+  std::string append = "";  // .idx file the sequences are appended to
 };
 
 void parseArgs(int argc, char *const argv[], Args &arg)
@@ -50,18 +51,22 @@ void parseArgs(int argc, char *const argv[], Args &arg)
   extern char *optarg;
   extern int optind;
 
-  std::string usage("usage: " + std::string(argv[0]) + " infile [-o outpath]\n\n" +
+  std::string usage("usage: " + std::string(argv[0]) + " infile [-o outpath] [-a idx]\n\n" +
                     "Computes the .idx file storing the sequence names and starting positions.\n" +
-                    "outpath: [string]  - path to where to output the file.\n");
+                    "outpath: [string]  - path to where to output the file.\n" +
+                    "    idx: [string]  - append the sequences to this .idx file, created if missing.\n");
 
   std::string sarg;
-  while ((c = getopt(argc, argv, "o:")) != -1)
+  while ((c = getopt(argc, argv, "o:a:")) != -1)
   {
     switch (c)
     {
     case 'o':
       arg.outpath.assign(optarg);
       break;
+    case 'a':
+      arg.append.assign(optarg);
+      break;
     case 'h':
       error(usage);
     case '?':
@@ -102,13 +107,29 @@ int main(int argc, char *const argv[])
 
 
   std::string outfile = "";
-  if(args.outpath == "") outfile = args.filename;
-  else outfile = args.outpath + std::string(basename(args.filename.data()));
-  // else outfile = args.outpath + fs::path(args.filename).filename().string();
-  outfile += idx.get_file_extension();
+  if(args.append != "")
+  {
+    // The text of the sequences follows the one of the sequences in the file
+    seqidx res;
+    std::ifstream in(args.append);
+    if (in.is_open())
+      res.load(in);
+    in.close();
+    res.append(idx);
+
+    std::ofstream out(args.append);
+    res.serialize(out);
+  }
+  else
+  {
+    if(args.outpath == "") outfile = args.filename;
+    else outfile = args.outpath + std::string(basename(args.filename.data()));
+    // else outfile = args.outpath + fs::path(args.filename).filename().string();
+    outfile += idx.get_file_extension();
 
-  std::ofstream out(outfile);
-  idx.serialize(out);
+    std::ofstream out(outfile);
+    idx.serialize(out);
+  }
 
   t_insert_end = std::chrono::high_resolution_clock::now();
 
@@ -99,55 +99,89 @@ int main(int argc, char *const argv[])
 
   // Open the dictionary
   std::string dict_filename = args.filename + ".dict";
-  std::vector<uint8_t> dict;
-  read_file(dict_filename.c_str(), dict);
+  uint8_t *dict;
+  size_t dict_length;
+  map_file(dict_filename.c_str(), dict, dict_length);
+  if (dict_length > 0)
+    madvise(dict, dict_length, MADV_SEQUENTIAL);
+
+  // Output buffers, written when full
+  const size_t buffer_size = 1 << 22;
+  std::vector<uint8_t> dicz_buffer;
+  std::vector<uint32_t> dicz_len_buffer;
+  dicz_buffer.reserve(buffer_size);
+  dicz_len_buffer.reserve(buffer_size / sizeof(uint32_t));
+
+  auto flush_dicz = [&]() {
+    if ((fwrite(dicz_buffer.data(), sizeof(uint8_t), dicz_buffer.size(), dicz)) != dicz_buffer.size())
+      error("fwrite() file " + std::string(dicz_filename) + " failed");
+    dicz_buffer.clear();
+  };
+
+  auto flush_dicz_len = [&]() {
+    if ((fwrite(dicz_len_buffer.data(), sizeof(uint32_t), dicz_len_buffer.size(), dicz_len)) != dicz_len_buffer.size())
+      error("fwrite() file " + std::string(dicz_len_filename) + " failed");
+    dicz_len_buffer.clear();
+  };
+
+  // Writes the phrase starting at ptr of the given length, without its last
+  // w characters.
+  size_t n_phrases = 0;
+  auto write_phrase = [&](const uint8_t *ptr, const size_t length) {
+    size_t compressed_length = length - args.w;
+
+    if (dicz_len_buffer.size() == dicz_len_buffer.capacity())
+      flush_dicz_len();
+    dicz_len_buffer.push_back(compressed_length);
+
+    if (dicz_buffer.size() + compressed_length > buffer_size)
+      flush_dicz();
+    if (compressed_length > buffer_size)
+    {
+      if ((fwrite(ptr, sizeof(uint8_t), compressed_length, dicz)) != compressed_length)
+        error("fwrite() file " + std::string(dicz_filename) + " failed");
+    }
+    else
+      dicz_buffer.insert(dicz_buffer.end(), ptr, ptr + compressed_length);
+
+    n_phrases++;
+  };
 
   // Start processing
+  verbose("Generating phrases");
+
+  // Skipping the Dollars at the beginning
+  size_t i = 0;
+  while (i < dict_length and dict[i] == Dollar)
+    i++;
 
-  
-  // Generating phrase lengths
-  verbose("Generating phrase lengths");
-  std::vector<size_t> lengths(1,0);
-  
-  // Counting the number of Dollars at the beginning
-  size_t i = 0, j = 0;
-  while(dict[i++] == Dollar)
-    j++;
-  dict.erase(dict.begin(), dict.begin() + j);
-
-  for(auto chr: dict)
+  const uint8_t *ptr = dict + i; // Beginning of the current phrase
+  size_t length = 0;
+  for (; i < dict_length; ++i)
   {
     // Skip the Dollars
-    if(chr == EndOfDict)
+    if (dict[i] == EndOfDict)
       continue;
 
     // Hit end of phrase
-    if(chr == EndOfWord)
-      lengths.push_back(0);
+    if (dict[i] == EndOfWord)
+    {
+      write_phrase(ptr, length);
+      ptr = dict + i + 1;
+      length = 0;
+    }
     else
-      lengths.back()++;
+      length++;
   }
 
-  if (lengths.back()==0)
-    lengths.pop_back();
-
-  verbose("Found", lengths.size(), " phrases ");
-
-  verbose("Generating phrases");
-  uint8_t* ptr = dict.data(); // Beginning of the current phrase
-  for(auto length: lengths)
-  {
-    size_t compressed_length = length - args.w;
-
-    if ((fwrite(&compressed_length, 4, 1, dicz_len)) != 1)
-      error("fwrite() file " + std::string(dicz_len_filename) + " failed");
-
-    if ((fwrite(ptr, sizeof(uint8_t), compressed_length, dicz)) != compressed_length)
-      error("fwrite() file " + std::string(dicz_filename) + " failed");
+  if (length > 0)
+    write_phrase(ptr, length);
 
-    ptr += length + 1;
-  }
+  flush_dicz();
+  flush_dicz_len();
+  unmap_file(dict, dict_length);
 
+  verbose("Found", n_phrases, " phrases ");
 
   fclose(dicz);
   fclose(dicz_len);
@@ -53,10 +53,26 @@ struct Args
 {
   std::string filename = "";
   std::string patterns = ""; // path to patterns file
+  std::string output   = ""; // output file prefix
   size_t l = 25;             // minumum MEM length
   size_t th = 1;             // number of threads
   size_t b = 1;              // number of batches per thread pool
+  bool bam = false;          // write the output in BAM format
+  std::string mates = "";    // path to the file with the second mates
+  bool interleaved = false;  // the mates are interleaved in the patterns file
+  size_t bgzf_th = 0;        // number of BGZF compression threads
+  size_t stats_period = 0;   // seconds between two reports of the extension profile
+  bool mmap = false;         // read the index files through a memory mapping
+  numa_policy numa = NUMA_NONE; // placement of the index on the NUMA nodes
   bool shaped_slp = false;   // use shaped slp
+  size_t ext_len = 100;      // Extension length
+  size_t cache_blocks = 16384; // Number of reference blocks cached per thread
+
+  // klib parameters
+  int sa = 2;                // Match score
+  int sb = 2;                // Mismatch penalty
+  int gapo = 5;              // Gap open penalty
+  int gape = 2;              // Gap extension penalty
 };
 
 void parseArgs(int argc, char *const argv[], Args &arg)
@@ -65,22 +81,39 @@ void parseArgs(int argc, char *const argv[], Args &arg)
   extern char *optarg;
   extern int optind;
 
-  std::string usage("usage: " + std::string(argv[0]) + " infile [-p patterns] [-t threads] [-l len] [-q shaped_slp] [-b batch]\n\n" +
+  std::string usage("usage: " + std::string(argv[0]) + " infile [-p patterns] [-o output] [-t threads] [-l len] [-q shaped_slp] [-b batch] [-L ext_l] [-A smatch] [-B smismatch] [-O gapo] [-E gape] [-c cache] [-z] [-Z bgzf_threads] [-m mates] [-i] [-P period] [-M] [-N numa]\n\n" +
                     "Extends the MEMs of the reads in the pattern against the reference index in infile.\n" +
                     "shaped_slp: [boolean] - use shaped slp. (def. false)\n" +
                     "   pattens: [string]  - path to patterns file.\n" +
+                    "    output: [string]  - output file prefix.\n" +
                     "       len: [integer] - minimum MEM lengt (def. 25)\n" +
                     "    thread: [integer] - number of threads (def. 1)\n" +
-                    "     batch: [integer] - number of batches per therad pool (def. 1)\n");
+                    "     ext_l: [integer] - length of reference aligned beyond each end of the read (def. " + std::to_string(arg.ext_len) + ")\n" +
+                    "    smatch: [integer] - match score value (def. " + std::to_string(arg.sa) + ")\n" +
+                    " smismatch: [integer] - mismatch penalty value (def. " + std::to_string(arg.sb) + ")\n" +
+                    "      gapo: [integer] - gap open penalty value (def. " + std::to_string(arg.gapo) + ")\n" +
+                    "      gape: [integer] - gap extension penalty value (def. " + std::to_string(arg.gape) + ")\n" +
+                    "     batch: [integer] - number of batches per therad pool (def. 1)\n" +
+                    "     cache: [integer] - number of reference blocks cached per thread, 0 to disable (def. " + std::to_string(arg.cache_blocks) + ")\n" +
+                    "         z: [boolean] - write the alignments in BAM format. (def. false)\n" +
+                    "bgzf_threads: [integer] - number of BGZF compression threads, 0 for one per thread (def. 0)\n" +
+                    "     mates: [string]  - path to the file with the second mates of paired-end reads.\n" +
+                    "         i: [boolean] - the patterns are interleaved paired-end reads. (def. false)\n" +
+                    "    period: [integer] - seconds between two reports of the extension profile, 0 to report only at the end (def. 0)\n" +
+                    "         M: [boolean] - read the index files through a memory mapping. (def. false)\n" +
+                    "      numa: [string]  - index placement on the NUMA nodes: none, interleave, or replicate one copy per node. (def. none)\n");
 
   std::string sarg;
-  while ((c = getopt(argc, argv, "l:hp:b:t:")) != -1)
+  while ((c = getopt(argc, argv, "l:hp:o:b:t:qA:B:O:E:L:c:zZ:m:iP:MN:")) != -1)
   {
     switch (c)
     {
     case 'p':
       arg.patterns.assign(optarg);
       break;
+    case 'o':
+      arg.output.assign(optarg);
+      break;
     case 'l':
       sarg.assign(optarg);
       arg.l = stoi(sarg);
@@ -89,10 +122,57 @@ void parseArgs(int argc, char *const argv[], Args &arg)
       sarg.assign(optarg);
       arg.th = stoi(sarg);
       break;
+    case 'm':
+      arg.mates.assign(optarg);
+      break;
+    case 'i':
+      arg.interleaved = true;
+      break;
+    case 'z':
+      arg.bam = true;
+      break;
+    case 'Z':
+      sarg.assign(optarg);
+      arg.bgzf_th = stoi(sarg);
+      break;
+    case 'P':
+      sarg.assign(optarg);
+      arg.stats_period = stoi(sarg);
+      break;
+    case 'M':
+      arg.mmap = true;
+      break;
+    case 'N':
+      arg.numa = parse_numa_policy(optarg);
+      break;
     case 'b':
       sarg.assign(optarg);
       arg.b = stoi(sarg);
       break;
+    case 'L':
+      sarg.assign(optarg);
+      arg.ext_len = stoi(sarg);
+      break;
+    case 'c':
+      sarg.assign(optarg);
+      arg.cache_blocks = stoi(sarg);
+      break;
+    case 'A':
+      sarg.assign(optarg);
+      arg.sa = stoi(sarg);
+      break;
+    case 'B':
+      sarg.assign(optarg);
+      arg.sb = stoi(sarg);
+      break;
+    case 'O':
+      sarg.assign(optarg);
+      arg.gapo = stoi(sarg);
+      break;
+    case 'E':
+      sarg.assign(optarg);
+      arg.gape = stoi(sarg);
+      break;
     case 'q':
       arg.shaped_slp = true;
       break;
@@ -117,12 +197,32 @@ void parseArgs(int argc, char *const argv[], Args &arg)
 //********** end argument options ********************
 
 
+template<typename extender_t>
+typename extender_t::config_t configurer(Args &args){
+  typename extender_t::config_t config;
+
+  config.min_len    = args.l;           // Minimum MEM length
+  config.ext_len    = args.ext_len;     // Extension length
+  config.cache_blocks = args.cache_blocks; // Number of reference blocks cached per thread
+  config.mmap       = args.mmap;        // Read the index files through a memory mapping
+
+  // klib parameters
+  config.sa         = args.sa;          // Match score
+  config.sb         = args.sb;          // Mismatch penalty
+  config.gapo       = args.gapo;        // Gap open penalty
+  config.gape       = args.gape;        // Gap extension penalty
+
+  return config;
+}
+
 template<typename extender_t>
 void dispatcher(Args &args){
   verbose("Construction of the extender");
   std::chrono::high_resolution_clock::time_point t_insert_start = std::chrono::high_resolution_clock::now();
 
-  extender_t extender(args.filename, args.l);
+  // The copies of the index are needed only by the workers of mt_extend
+  numa_replicas<extender_t> replicas((args.th > 1 ? args.numa : NUMA_NONE), [&]() { return new extender_t(args.filename, configurer<extender_t>(args)); });
+  extender_t &extender = *replicas.primary();
 
   std::chrono::high_resolution_clock::time_point t_insert_end = std::chrono::high_resolution_clock::now();
   verbose("Memory peak: ", malloc_count_peak());
@@ -133,17 +233,26 @@ void dispatcher(Args &args){
 
   std::string base_name = basename(args.filename.data());
   std::string sam_filename = args.patterns + "_" + base_name + "_" + std::to_string(args.l);
+  if(args.output != "")
+    sam_filename = args.output;
+
+  bool paired = (args.interleaved or args.mates != "");
+  if (args.interleaved and args.mates != "")
+    error("The mates cannot be both interleaved and in a separate file");
 
-  if (is_gzipped(args.patterns))
+  if (is_gzipped(args.patterns) or (args.mates != "" and is_gzipped(args.mates)))
   {
     verbose("The input is gzipped - forcing single thread extension.");
     args.th = 1;
   }
 
+  // By default one compression thread per extension thread
+  size_t bgzf_th = (args.bgzf_th > 0 ? args.bgzf_th : args.th);
+
   if (args.th == 1)
-    st_extend<extender_t>(&extender, args.patterns, sam_filename);
+    st_extend<extender_t>(&extender, args.patterns, sam_filename, args.bam, bgzf_th, paired, args.mates, args.stats_period);
   else
-    mt_extend<extender_t>(&extender, args.patterns, sam_filename, args.th, args.b);
+    mt_extend<extender_t>(&extender, args.patterns, sam_filename, args.th, args.b, args.bam, bgzf_th, paired, args.mates, args.stats_period, &replicas);
 
   // TODO: Merge the SAM files.
 
@@ -54,8 +54,17 @@ struct Args
   size_t l = 25;             // minumum MEM length
   size_t th = 1;             // number of threads
   size_t b = 1;              // number of batches per thread pool
+  bool bam = false;          // write the output in BAM format
+  bool local = false;        // soft-clip the read ends
+  std::string mates = "";    // path to the file with the second mates
+  bool interleaved = false;  // the mates are interleaved in the patterns file
+  size_t bgzf_th = 0;        // number of BGZF compression threads
+  size_t stats_period = 0;   // seconds between two reports of the extension profile
+  bool mmap = false;         // read the index files through a memory mapping
+  numa_policy numa = NUMA_NONE; // placement of the index on the NUMA nodes
   bool shaped_slp = false;   // use shaped slp
   size_t ext_len = 100;      // Extension length
+  size_t cache_blocks = 16384; // Number of reference blocks cached per thread
   // size_t top_k = 1;       // Report the top_k alignments
 
   // ksw2 parameters
@@ -77,7 +86,7 @@ void parseArgs(int argc, char *const argv[], Args &arg)
   extern char *optarg;
   extern int optind;
 
-  std::string usage("usage: " + std::string(argv[0]) + " infile [-p patterns] [-t threads] [-l len] [-q shaped_slp] [-b batch] [-L ext_l] [-A smatch] [-B smismatc] [-O gapo] [-E gape]\n\n" +
+  std::string usage("usage: " + std::string(argv[0]) + " infile [-p patterns] [-t threads] [-l len] [-q shaped_slp] [-b batch] [-L ext_l] [-A smatch] [-B smismatc] [-O gapo] [-E gape] [-c cache] [-z] [-Z bgzf_threads] [-m mates] [-i] [-s] [-P period] [-M] [-N numa]\n\n" +
                     "Extends the MEMs of the reads in the pattern against the reference index in infile.\n" +
                     "shaped_slp: [boolean] - use shaped slp. (def. false)\n" +
                     "   pattens: [string]  - path to patterns file.\n" +
@@ -89,11 +98,20 @@ void parseArgs(int argc, char *const argv[], Args &arg)
                     " smismatch: [integer] - mismatch penalty value (def. " + std::to_string(arg.smismatch) + ")\n" +
                     "      gapo: [integer] - gap open penalty value (def. " + std::to_string(arg.gapo) + "," + std::to_string(arg.gapo2) + ")\n" +
                     "      gape: [integer] - gap extension penalty value (def. " + std::to_string(arg.gape) + "," + std::to_string(arg.gape2) + ")\n" +
-                    "     batch: [integer] - number of batches per therad pool (def. 1)\n");
+                    "     batch: [integer] - number of batches per therad pool (def. 1)\n" +
+                    "     cache: [integer] - number of reference blocks cached per thread, 0 to disable (def. " + std::to_string(arg.cache_blocks) + ")\n" +
+                    "         z: [boolean] - write the alignments in BAM format. (def. false)\n" +
+                    "bgzf_threads: [integer] - number of BGZF compression threads, 0 for one per thread (def. 0)\n" +
+                    "     mates: [string]  - path to the file with the second mates of paired-end reads.\n" +
+                    "         i: [boolean] - the patterns are interleaved paired-end reads. (def. false)\n" +
+                    "         s: [boolean] - stop the extensions at their best scoring end and soft-clip the read ends. (def. false)\n" +
+                    "    period: [integer] - seconds between two reports of the extension profile, 0 to report only at the end (def. 0)\n" +
+                    "         M: [boolean] - read the index files through a memory mapping. (def. false)\n" +
+                    "      numa: [string]  - index placement on the NUMA nodes: none, interleave, or replicate one copy per node. (def. none)\n");
 
   std::string sarg;
   char* s;
-  while ((c = getopt(argc, argv, "l:hp:o:b:t:qA:B:O:E:L:")) != -1)
+  while ((c = getopt(argc, argv, "l:hp:o:b:t:qA:B:O:E:L:c:zZ:m:isP:MN:")) != -1)
   {
     switch (c)
     {
@@ -111,6 +129,32 @@ void parseArgs(int argc, char *const argv[], Args &arg)
       sarg.assign(optarg);
       arg.th = stoi(sarg);
       break;
+    case 'm':
+      arg.mates.assign(optarg);
+      break;
+    case 'i':
+      arg.interleaved = true;
+      break;
+    case 's':
+      arg.local = true;
+      break;
+    case 'z':
+      arg.bam = true;
+      break;
+    case 'Z':
+      sarg.assign(optarg);
+      arg.bgzf_th = stoi(sarg);
+      break;
+    case 'P':
+      sarg.assign(optarg);
+      arg.stats_period = stoi(sarg);
+      break;
+    case 'M':
+      arg.mmap = true;
+      break;
+    case 'N':
+      arg.numa = parse_numa_policy(optarg);
+      break;
     case 'b':
       sarg.assign(optarg);
       arg.b = stoi(sarg);
@@ -119,6 +163,10 @@ void parseArgs(int argc, char *const argv[], Args &arg)
       sarg.assign(optarg);
       arg.ext_len = stoi(sarg);
       break;
+    case 'c':
+      sarg.assign(optarg);
+      arg.cache_blocks = stoi(sarg);
+      break;
     case 'A':
       sarg.assign(optarg);
       arg.smatch = stoi(sarg);
@@ -165,6 +213,9 @@ typename extender_t::config_t configurer(Args &args){
   
   config.min_len    = args.l;           // Minimum MEM length
   config.ext_len    = args.ext_len;     // Extension length
+  config.cache_blocks = args.cache_blocks; // Number of reference blocks cached per thread
+  config.mmap       = args.mmap;        // Read the index files through a memory mapping
+  config.local      = args.local;       // Soft-clip the read ends
 
   // ksw2 parameters
   config.smatch     = args.smatch;      // Match score default
@@ -183,7 +234,9 @@ void dispatcher(Args &args){
   std::chrono::high_resolution_clock::time_point t_insert_start = std::chrono::high_resolution_clock::now();
 
 
-  extender_t extender(args.filename, configurer<extender_t>(args));
+  // The copies of the index are needed only by the workers of mt_extend
+  numa_replicas<extender_t> replicas((args.th > 1 ? args.numa : NUMA_NONE), [&]() { return new extender_t(args.filename, configurer<extender_t>(args)); });
+  extender_t &extender = *replicas.primary();
 
   std::chrono::high_resolution_clock::time_point t_insert_end = std::chrono::high_resolution_clock::now();
   verbose("Memory peak: ", malloc_count_peak());
@@ -197,16 +250,23 @@ void dispatcher(Args &args){
   if(args.output != "")
     sam_filename = args.output;
 
-  if (is_gzipped(args.patterns))
+  bool paired = (args.interleaved or args.mates != "");
+  if (args.interleaved and args.mates != "")
+    error("The mates cannot be both interleaved and in a separate file");
+
+  if (is_gzipped(args.patterns) or (args.mates != "" and is_gzipped(args.mates)))
   {
     verbose("The input is gzipped - forcing single thread extension.");
     args.th = 1;
   }
 
+  // By default one compression thread per extension thread
+  size_t bgzf_th = (args.bgzf_th > 0 ? args.bgzf_th : args.th);
+
   if (args.th == 1)
-    st_extend<extender_t>(&extender, args.patterns, sam_filename);
+    st_extend<extender_t>(&extender, args.patterns, sam_filename, args.bam, bgzf_th, paired, args.mates, args.stats_period);
   else
-    mt_extend<extender_t>(&extender, args.patterns, sam_filename, args.th, args.b);
+    mt_extend<extender_t>(&extender, args.patterns, sam_filename, args.th, args.b, args.bam, bgzf_th, paired, args.mates, args.stats_period, &replicas);
 
   // TODO: Merge the SAM files.
 
@@ -0,0 +1,163 @@
+/* fasta_to_text - Writes the concatenation of the sequences of a FASTA file and its sequence index
+    Copyright (C) 2026 Massimiliano Rossi
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see http://www.gnu.org/licenses/ .
+*/
+/*!
+   \file fasta_to_text.cpp
+   \brief fasta_to_text.cpp Writes the concatenation of the sequences of a FASTA file and its sequence index.
+   \author Massimiliano Rossi
+   \date 18/10/2026
+
+   The output is the text indexed by moni, the sequences without headers and
+   newlines, the same positions of the .idx file. It is the input of the
+   multithreaded parsing, that does not read FASTA files. The .idx file is
+   built in the same pass, so build_seqidx does not need to read the
+   reference again.
+*/
+
+#include <iostream>
+#include <fstream>
+
+#define VERBOSE
+
+#include <common.hpp>
+
+#include <malloc_count.h>
+#include <kseq.h>
+#include <zlib.h>
+
+KSEQ_INIT(gzFile, gzread);
+
+#include <seqidx.hpp>
+
+#include <libgen.h>
+
+//*********************** Argument options ***************************************
+// struct containing command line parameters and other globals
+struct Args
+{
+  std::string filename = "";
+  std::string outfile = ""; // output file
+  std::string outpath = ""; // path where to output the .idx file
+};
+
+void parseArgs(int argc, char *const argv[], Args &arg)
+{
+  int c;
+  extern char *optarg;
+  extern int optind;
+
+  std::string usage("usage: " + std::string(argv[0]) + " infile [-o outfile] [-i outpath]\n\n" +
+                    "Writes the concatenation of the sequences of the FASTA file infile, and the .idx file\n" +
+                    "storing the sequence names and starting positions.\n" +
+                    "outfile: [string]  - output file. (def. infile.txt)\n" +
+                    "outpath: [string]  - path to where to output the .idx file.\n");
+
+  std::string sarg;
+  while ((c = getopt(argc, argv, "o:i:h")) != -1)
+  {
+    switch (c)
+    {
+    case 'o':
+      arg.outfile.assign(optarg);
+      break;
+    case 'i':
+      arg.outpath.assign(optarg);
+      break;
+    case 'h':
+      error(usage);
+    case '?':
+      error("Unknown option.\n", usage);
+      exit(1);
+    }
+  }
+  // the only input parameter is the file name
+  if (argc == optind + 1)
+  {
+    arg.filename.assign(argv[optind]);
+  }
+  else
+  {
+    error("Invalid number of arguments\n", usage);
+  }
+}
+
+//********** end argument options ********************
+
+int main(int argc, char *const argv[])
+{
+  Args args;
+  parseArgs(argc, argv, args);
+
+  if (args.outfile == "")
+    args.outfile = args.filename + ".txt";
+
+  verbose("Writing the sequences of", args.filename, "to", args.outfile);
+  std::chrono::high_resolution_clock::time_point t_insert_start = std::chrono::high_resolution_clock::now();
+
+  gzFile fp = gzopen(args.filename.c_str(), "r");
+  if (fp == Z_NULL)
+    error("gzopen() file " + args.filename + " failed");
+
+  FILE *out = fopen(args.outfile.c_str(), "wb");
+  if (out == NULL)
+    error("open() file " + args.outfile + " failed");
+
+  kseq_t *seq = kseq_init(fp);
+  size_t n = 0;
+  std::vector<size_t> onset;
+  std::vector<std::string> names;
+  size_t n_empty = 0;
+  while (kseq_read(seq) >= 0)
+  {
+    // Empty sequences have no position in the text, and are not indexed
+    if (seq->seq.l == 0)
+    {
+      n_empty++;
+      continue;
+    }
+    if (fwrite(seq->seq.s, sizeof(char), seq->seq.l, out) != seq->seq.l)
+      error("fwrite() file " + args.outfile + " failed");
+    onset.push_back(n);
+    names.push_back(std::string(seq->name.s));
+    n += seq->seq.l;
+  }
+
+  kseq_destroy(seq);
+  gzclose(fp);
+  if (fclose(out) != 0)
+    error("fclose() file " + args.outfile + " failed");
+
+  std::chrono::high_resolution_clock::time_point t_insert_end = std::chrono::high_resolution_clock::now();
+
+  verbose("Sequences:", names.size(), "Length:", n);
+  if (n_empty > 0)
+    warning("Skipped", n_empty, "empty sequences");
+  verbose("Memory peak: ", malloc_count_peak());
+  verbose("Elapsed time (s): ", std::chrono::duration<double, std::ratio<1>>(t_insert_end - t_insert_start).count());
+
+  if (names.empty())
+    error("No sequences in " + args.filename);
+
+  seqidx idx(onset, names, n);
+
+  std::string idxfile = "";
+  if(args.outpath == "") idxfile = args.filename;
+  else idxfile = args.outpath + std::string(basename(args.filename.data()));
+  idxfile += idx.get_file_extension();
+
+  std::ofstream idx_out(idxfile);
+  idx.serialize(idx_out);
+
+  verbose("Sequence index written to", idxfile);
+  return 0;
+}
@@ -28,203 +28,17 @@ extern "C" {
 
 #include <common.hpp>
 
-#include <sdsl/io.hpp>
+#include <kseq_utils.hpp>
+#include <ms_index.hpp>
+#include <numa_utils.hpp>
 
-#include <ms_pointers.hpp>
-
-#include <malloc_count.h>
-
-#include <SelfShapedSlp.hpp>
-#include <DirectAccessibleGammaCode.hpp>
-#include <SelectType.hpp>
-#include <PlainSlp.hpp>
-#include <FixedBitLenCode.hpp>
-
-////////////////////////////////////////////////////////////////////////////////
-/// kseq extra
-////////////////////////////////////////////////////////////////////////////////
-
-static inline size_t ks_tell(kseq_t *seq)
-{
-  return gztell(seq->f->f) - seq->f->end + seq->f->begin;
-}
-
-void copy_kstring_t(kstring_t &l, kstring_t &r)
-{
-  l.l = r.l;
-  l.m = r.m;
-  l.s = (char *)malloc(l.m);
-  for (size_t i = 0; i < r.m; ++i)
-    l.s[i] = r.s[i];
-}
-void copy_kseq_t(kseq_t *l, kseq_t *r)
-{
-  copy_kstring_t(l->name, r->name);
-  copy_kstring_t(l->comment, r->comment);
-  copy_kstring_t(l->seq, r->seq);
-  copy_kstring_t(l->qual, r->qual);
-  l->last_char = r->last_char;
-}
-
-////////////////////////////////////////////////////////////////////////////////
-/// Parallel computation
-////////////////////////////////////////////////////////////////////////////////
-
-// This should be done using buffering.
-size_t next_start_fastq(gzFile fp)
-{
-  int c;
-  // Special case when we arr at the beginning of the file.
-  if ((gztell(fp) == 0) && ((c = gzgetc(fp)) != EOF) && c == '@')
-    return 0;
-
-  // Strart from the previous character
-  gzseek(fp, -1, SEEK_CUR);
-
-  std::vector<std::pair<int, size_t>> window;
-  // Find the first new line
-  for (size_t i = 0; i < 4; ++i)
-  {
-    while (((c = gzgetc(fp)) != EOF) && (c != (int)'\n'))
-    {
-    }
-    if (c == EOF)
-      return gztell(fp);
-    if ((c = gzgetc(fp)) == EOF)
-      return gztell(fp);
-    window.push_back(std::make_pair(c, gztell(fp) - 1));
-  }
-
-  for (size_t i = 0; i < 2; ++i)
-  {
-    if (window[i].first == '@' && window[i + 2].first == '+')
-      return window[i].second;
-    if (window[i].first == '+' && window[i + 2].first == '@')
-      return window[i + 2].second;
-  }
-
-  return gztell(fp);
-}
-
-// test if the file is gzipped
-static inline bool is_gzipped(std::string filename)
-{
-  FILE *fp = fopen(filename.c_str(), "rb");
-  if(fp == NULL) error("Opening file " + filename);
-  int byte1 = 0, byte2 = 0;
-  fread(&byte1, sizeof(char), 1, fp);
-  fread(&byte2, sizeof(char), 1, fp);
-  fclose(fp);
-  return (byte1 == 0x1f && byte2 == 0x8b);
-}
-
-// Return the length of the file
-// Assumes that the file is not compressed
-static inline size_t get_file_size(std::string filename)
-{
-  if (is_gzipped(filename))
-  {
-    std::cerr << "The input is gzipped!" << std::endl;
-    return -1;
-  }
-  FILE *fp = fopen(filename.c_str(), "r");
-  fseek(fp, 0L, SEEK_END);
-  size_t size = ftell(fp);
-  fclose(fp);
-  return size;
-}
-
-std::vector<size_t> split_fastq(std::string filename, size_t n_threads)
-{
-  //Precondition: the file is not gzipped
-  // scan file for start positions and execute threads
-  size_t size = get_file_size(filename);
-
-  gzFile fp = gzopen(filename.c_str(), "r");
-  if (fp == Z_NULL)
-  {
-    throw new std::runtime_error("Cannot open input file " + filename);
-  }
-
-  std::vector<size_t> starts(n_threads + 1);
-  for (int i = 0; i < n_threads + 1; ++i)
-  {
-    size_t start = (size_t)((size * i) / n_threads);
-    gzseek(fp, start, SEEK_SET);
-    starts[i] = next_start_fastq(fp);
-  }
-  gzclose(fp);
-  return starts;
-}
-
-////////////////////////////////////////////////////////////////////////////////
-/// SLP definitions
-////////////////////////////////////////////////////////////////////////////////
-
-using SelSd = SelectSdvec<>;
-using DagcSd = DirectAccessibleGammaCode<SelSd>;
-using Fblc = FixedBitLenCode<>;
-
-using shaped_slp_t = SelfShapedSlp<uint32_t, DagcSd, DagcSd, SelSd>;
-using plain_slp_t = PlainSlp<uint32_t, Fblc, Fblc>;
-
-template <typename slp_t>
-std::string get_slp_file_extension()
-{
-  return std::string(".slp");
-}
-
-template <>
-std::string get_slp_file_extension<shaped_slp_t>()
-{
-  return std::string(".slp");
-}
-
-template <>
-std::string get_slp_file_extension<plain_slp_t>()
-{
-  return std::string(".plain.slp");
-}
-////////////////////////////////////////////////////////////////////////////////
-
-template <typename slp_t>
-class mems_c
+template <typename slp_t, typename ms_t = ms_pointers<>>
+class mems_c : public ms_index<slp_t, ms_t>
 {
 public:
 
-  mems_c(std::string filename)
+  mems_c(std::string filename, const bool use_mmap = false) : ms_index<slp_t, ms_t>(filename, use_mmap)
   {
-    verbose("Loading the matching statistics index");
-    std::chrono::high_resolution_clock::time_point t_insert_start = std::chrono::high_resolution_clock::now();
-
-    std::string filename_ms = filename + ms.get_file_extension();
-
-    ifstream fs_ms(filename_ms);
-    ms.load(fs_ms);
-    fs_ms.close();
-
-    std::chrono::high_resolution_clock::time_point t_insert_end = std::chrono::high_resolution_clock::now();
-
-    verbose("Matching statistics index construction complete");
-    verbose("Memory peak: ", malloc_count_peak());
-    verbose("Elapsed time (s): ", std::chrono::duration<double, std::ratio<1>>(t_insert_end - t_insert_start).count());
-
-    verbose("Loading random access");
-    t_insert_start = std::chrono::high_resolution_clock::now();
-
-    std::string filename_slp = filename + get_slp_file_extension<slp_t>();
-
-    ifstream fs(filename_slp);
-    ra.load(fs);
-    fs.close();
-
-    n = ra.getLen();
-
-    t_insert_end = std::chrono::high_resolution_clock::now();
-
-    verbose("Matching statistics index loading complete");
-    verbose("Memory peak: ", malloc_count_peak());
-    verbose("Elapsed time (s): ", std::chrono::duration<double, std::ratio<1>>(t_insert_end - t_insert_start).count());
   }
 
   // Destructor
@@ -240,34 +54,10 @@ public:
   // the MEMs.
   void maxrimal_exact_matches(kseq_t *read, FILE* out)
   {
-    auto pointers = ms.query(read->seq.s, read->seq.l);
-    std::vector<size_t> lengths(pointers.size());
+    std::vector<size_t> pointers, lengths;
     std::vector<std::pair<size_t,size_t>> mems;
-
-    size_t l = 0;
-    for (size_t i = 0; i < pointers.size(); ++i)
-    {
-      size_t pos = pointers[i];
-      while ((i + l) < read->seq.l && (pos + l) < n && (i < 1 || pos != (pointers[i-1] + 1) ) && read->seq.s[i + l] == ra.charAt(pos + l))
-        ++l;
-
-      lengths[i] = l;
-      l = (l == 0 ? 0 : (l - 1));
- 
-      if((i == 0) or (lengths[i] >= lengths[i-1]))
-        mems.push_back(make_pair(i,lengths[i]));
-    }
-
-    // Original MS computation
-    // for (size_t i = 0; i < pointers.size(); ++i)
-    // {
-    //   size_t pos = pointers[i];
-    //   while ((i + l) < read->seq.l && (pos + l) < n && read->seq.s[i + l] == ra.charAt(pos + l))
-    //     ++l;
-
-    //   lengths[i] = l;
-    //   l = (l == 0 ? 0 : (l - 1));
-    // }
+    ms_index<slp_t, ms_t>::matching_statistics(read->seq.s, read->seq.l, pointers, lengths);
+    ms_index<slp_t, ms_t>::mems(lengths, mems);
 
     assert(lengths.size() == pointers.size());
 
@@ -278,32 +68,10 @@ public:
     fwrite(&q_length, sizeof(size_t), 1,out);
     fwrite(mems.data(), sizeof(std::pair<size_t,size_t>),q_length,out);
   }
-
-protected:
-  ms_pointers<> ms;
-  slp_t ra;
-  size_t n = 0;
 };
 
 
 
-char complement(char n)
-{
-  switch (n)
-  {
-  case 'A':
-    return 'T';
-  case 'T':
-    return 'A';
-  case 'G':
-    return 'C';
-  case 'C':
-    return 'G';
-  default:
-    return n;
-  }
-}
-
 template <typename ms_t>
 struct mt_param_t
 {
@@ -314,6 +82,7 @@ struct mt_param_t
   size_t start;
   size_t end;
   size_t wk_id;
+  numa_replicas<ms_t> *replicas; // Null if the workers are not pinned
 };
 
 template <typename ms_t>
@@ -334,6 +103,9 @@ void *mt_ms_worker(void *param)
 
   gzseek(fp, p->start, SEEK_SET);
 
+  if (p->replicas != nullptr)
+    p->replicas->pin(p->wk_id);
+
   kseq_t rev;
   int l;
 
@@ -353,19 +125,20 @@ void *mt_ms_worker(void *param)
 }
 
 template <typename ms_t>
-void mt_ms(ms_t *ms, std::string pattern_filename, std::string out_filename, size_t n_threads)
+void mt_ms(ms_t *ms, std::string pattern_filename, std::string out_filename, size_t n_threads, numa_replicas<ms_t> *replicas = nullptr)
 {
   pthread_t t[n_threads] = {0};
   mt_param_t<ms_t> params[n_threads];
   std::vector<size_t> starts = split_fastq(pattern_filename, n_threads);
   for(size_t i = 0; i < n_threads; ++i)
   {
-    params[i].ms = ms;
+    params[i].ms = (replicas != nullptr ? replicas->get(i) : ms);
     params[i].pattern_filename = pattern_filename;
     params[i].out_filename = out_filename + "_" + std::to_string(i) + ".mems.tmp.out";
     params[i].start = starts[i];
     params[i].end = starts[i+1];
     params[i].wk_id = i;
+    params[i].replicas = replicas;
     xpthread_create(&t[i], NULL, &mt_ms_worker<ms_t>, &params[i], __LINE__, __FILE__);
   }
 
@@ -429,6 +202,8 @@ struct Args
   size_t l = 25;             // minumum MEM length
   size_t th = 1;             // number of threads
   bool shaped_slp = false;   // use shaped slp
+  bool mmap = false;         // read the index files through a memory mapping
+  numa_policy numa = NUMA_NONE; // placement of the index on the NUMA nodes
 };
 
 void parseArgs(int argc, char *const argv[], Args &arg)
@@ -437,16 +212,18 @@ void parseArgs(int argc, char *const argv[], Args &arg)
   extern char *optarg;
   extern int optind;
 
-  std::string usage("usage: " + std::string(argv[0]) + " infile [-p patterns] [-o output] [-t threads] [-l len] [-q shaped_slp] [-b batch]\n\n" +
+  std::string usage("usage: " + std::string(argv[0]) + " infile [-p patterns] [-o output] [-t threads] [-l len] [-q shaped_slp] [-b batch] [-M] [-N numa]\n\n" +
                     "Copmputes the matching statistics of the reads in the pattern against the reference index in infile.\n" +
                     "shaped_slp: [boolean] - use shaped slp. (def. false)\n" +
                     "   pattens: [string]  - path to patterns file.\n" +
                     "    output: [string]  - output file prefix.\n" +
                     "       len: [integer] - minimum MEM lengt (def. 25)\n" +
-                    "    thread: [integer] - number of threads (def. 1)\n");
+                    "    thread: [integer] - number of threads (def. 1)\n" +
+                    "         M: [boolean] - read the index files through a memory mapping. (def. false)\n" +
+                    "      numa: [string]  - index placement on the NUMA nodes: none, interleave, or replicate one copy per node. (def. none)\n");
 
   std::string sarg;
-  while ((c = getopt(argc, argv, "l:hp:o:t:")) != -1)
+  while ((c = getopt(argc, argv, "l:hp:o:t:qMN:")) != -1)
   {
     switch (c)
     {
@@ -467,6 +244,12 @@ void parseArgs(int argc, char *const argv[], Args &arg)
     case 'q':
       arg.shaped_slp = true;
       break;
+    case 'M':
+      arg.mmap = true;
+      break;
+    case 'N':
+      arg.numa = parse_numa_policy(optarg);
+      break;
     case 'h':
       error(usage);
     case '?':
@@ -493,7 +276,9 @@ void dispatcher(Args &args)
   verbose("Construction of the matching statistics data structure");
   std::chrono::high_resolution_clock::time_point t_insert_start = std::chrono::high_resolution_clock::now();
 
-  ms_t ms(args.filename);
+  // The copies of the index are needed only by the workers of mt_ms
+  numa_replicas<ms_t> replicas((args.th > 1 ? args.numa : NUMA_NONE), [&]() { return new ms_t(args.filename, args.mmap); });
+  ms_t &ms = *replicas.primary();
 
   std::chrono::high_resolution_clock::time_point t_insert_end = std::chrono::high_resolution_clock::now();
   verbose("Memory peak: ", malloc_count_peak());
@@ -516,7 +301,7 @@ void dispatcher(Args &args)
   if (args.th == 1)
     st_ms<ms_t>(&ms, args.patterns, out_filename);
   else
-    mt_ms<ms_t>(&ms, args.patterns, out_filename, args.th);
+    mt_ms<ms_t>(&ms, args.patterns, out_filename, args.th, &replicas);
 
   // TODO: Merge the SAM files.
 
@@ -604,6 +389,23 @@ void dispatcher(Args &args)
   verbose("Memory peak: ", malloc_count_peak());
 }
 
+// Selects the thresholds of the index from the extension of its matching
+// statistics pointers file, written by rlebwt_ms_build.
+template <typename slp_t>
+void thresholds_dispatcher(Args &args)
+{
+  if (has_ms_file<ms_pointers<>>(args.filename))
+    dispatcher<mems_c<slp_t>>(args);
+  else if (has_ms_file<ms_relative_t>(args.filename))
+    dispatcher<mems_c<slp_t, ms_relative_t>>(args);
+  else if (has_ms_file<ms_compact_t>(args.filename))
+    dispatcher<mems_c<slp_t, ms_compact_t>>(args);
+  else if (has_ms_file<ms_fused_t>(args.filename))
+    dispatcher<mems_c<slp_t, ms_fused_t>>(args);
+  else
+    error("No matching statistics index with prefix", args.filename);
+}
+
 int main(int argc, char *const argv[])
 {
   Args args;
@@ -611,11 +413,11 @@ int main(int argc, char *const argv[])
 
   if (args.shaped_slp)
   {
-    dispatcher<mems_c<shaped_slp_t>>(args);
+    thresholds_dispatcher<shaped_slp_t>(args);
   }
   else
   {
-    dispatcher<mems_c<plain_slp_t>>(args);
+    thresholds_dispatcher<plain_slp_t>(args);
   }
   return 0;
 }
\ No newline at end of file
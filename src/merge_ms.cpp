@@ -0,0 +1,228 @@
+/* merge_ms - Merges the matching statistics computed on the shards of an index
+    Copyright (C) 2026 Massimiliano Rossi
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see http://www.gnu.org/licenses/ .
+*/
+/*!
+   \file merge_ms.cpp
+   \brief merge_ms.cpp Merges the matching statistics computed on the shards of an index.
+   \author Massimiliano Rossi
+   \date 18/10/2026
+
+   Each shard indexes a part of the collection, whose text starts at the given
+   offset of the concatenation of the shards. The matching statistics of the
+   collection take, for each suffix of the read, the longest of the matches in
+   the shards, with its pointer moved by the offset of the shard.
+*/
+
+#include <iostream>
+#include <fstream>
+#include <memory>
+
+#define VERBOSE
+
+#include <common.hpp>
+
+#include <malloc_count.h>
+
+//*********************** Argument options ***************************************
+// struct containing command line parameters and other globals
+struct Args
+{
+  std::string outfile = "";
+  std::vector<std::string> shards;  // Prefixes of the .pointers and .lengths files
+  std::vector<size_t> offsets;      // Offsets of the shards
+  bool mems = false;                // Write the MEMs too
+};
+
+void parseArgs(int argc, char *const argv[], Args &arg)
+{
+  int c;
+  extern char *optarg;
+  extern int optind;
+
+  std::string usage("usage: " + std::string(argv[0]) + " outfile [-m] shard1 offset1 [shard2 offset2 ...]\n\n" +
+                    "Merges the matching statistics in shardi.pointers and shardi.lengths, computed on the shards of an index,\n" +
+                    "into outfile.pointers and outfile.lengths.\n" +
+                    "   offseti: [integer] - position of the text of the i-th shard in the collection.\n" +
+                    "        -m            - write the MEMs in outfile.mems.\n");
+
+  std::string sarg;
+  while ((c = getopt(argc, argv, "mh")) != -1)
+  {
+    switch (c)
+    {
+    case 'm':
+      arg.mems = true;
+      break;
+    case 'h':
+      error(usage);
+    case '?':
+      error("Unknown option.\n", usage);
+      exit(1);
+    }
+  }
+  // the output file followed by the pairs of shards and offsets
+  if (argc > optind + 2 and (argc - optind - 1) % 2 == 0)
+  {
+    arg.outfile.assign(argv[optind]);
+    for (int i = optind + 1; i < argc; i += 2)
+    {
+      arg.shards.push_back(std::string(argv[i]));
+      sarg.assign(argv[i + 1]);
+      arg.offsets.push_back(std::stoull(sarg));
+    }
+  }
+  else
+  {
+    error("Invalid number of arguments\n", usage);
+  }
+}
+
+//********** end argument options ********************
+
+// Reads the reads of a .pointers or .lengths file: a header line starting with
+// '>' followed by a line of integers.
+class ms_file_reader
+{
+public:
+  ms_file_reader(const std::string &filename_) : filename(filename_), in(filename_)
+  {
+    if (not in.is_open())
+      error("open() file " + filename + " failed");
+  }
+
+  bool next(std::string &name, std::vector<size_t> &values)
+  {
+    if (not std::getline(in, name))
+      return false;
+    if (name.empty() or name[0] != '>')
+      error("invilid file " + filename);
+
+    if (not std::getline(in, line))
+      error("invilid file " + filename);
+
+    values.clear();
+    const char *p = line.c_str();
+    char *end;
+    while (true)
+    {
+      size_t x = strtoull(p, &end, 10);
+      if (end == p)
+        break;
+      values.push_back(x);
+      p = end;
+    }
+    return true;
+  }
+
+protected:
+  std::string filename;
+  std::ifstream in;
+  std::string line;
+};
+
+int main(int argc, char *const argv[])
+{
+  Args args;
+  parseArgs(argc, argv, args);
+
+  verbose("Merging the matching statistics of", args.shards.size(), "shards");
+  std::chrono::high_resolution_clock::time_point t_insert_start = std::chrono::high_resolution_clock::now();
+
+  const size_t k = args.shards.size();
+  std::vector<std::unique_ptr<ms_file_reader>> pointers(k), lengths(k);
+  for (size_t s = 0; s < k; ++s)
+  {
+    pointers[s].reset(new ms_file_reader(args.shards[s] + ".pointers"));
+    lengths[s].reset(new ms_file_reader(args.shards[s] + ".lengths"));
+  }
+
+  std::ofstream f_pointers(args.outfile + ".pointers");
+  std::ofstream f_lengths(args.outfile + ".lengths");
+  std::ofstream f_mems;
+
+  if (!f_pointers.is_open())
+    error("open() file " + std::string(args.outfile) + ".pointers failed");
+
+  if (!f_lengths.is_open())
+    error("open() file " + std::string(args.outfile) + ".lengths failed");
+
+  if (args.mems)
+  {
+    f_mems.open(args.outfile + ".mems");
+    if (!f_mems.is_open())
+      error("open() file " + std::string(args.outfile) + ".mems failed");
+  }
+
+  std::vector<std::vector<size_t>> p(k), l(k);
+  std::string name, other;
+  size_t n_seq = 0;
+  while (pointers[0]->next(name, p[0]))
+  {
+    if (not lengths[0]->next(other, l[0]) or other != name or l[0].size() != p[0].size())
+      error("The matching statistics of " + name + " differ in " + args.shards[0]);
+
+    for (size_t s = 1; s < k; ++s)
+    {
+      if (not pointers[s]->next(other, p[s]) or other != name or p[s].size() != p[0].size())
+        error("The matching statistics of " + name + " differ in " + args.shards[s]);
+      if (not lengths[s]->next(other, l[s]) or other != name or l[s].size() != p[0].size())
+        error("The matching statistics of " + name + " differ in " + args.shards[s]);
+    }
+
+    const size_t m = p[0].size();
+    std::vector<size_t> merged(m);
+    f_pointers << name << std::endl;
+    f_lengths << name << std::endl;
+    for (size_t i = 0; i < m; ++i)
+    {
+      // The first shard wins the ties
+      size_t best = 0;
+      for (size_t s = 1; s < k; ++s)
+        if (l[s][i] > l[best][i])
+          best = s;
+
+      merged[i] = l[best][i];
+      f_pointers << args.offsets[best] + p[best][i] << " ";
+      f_lengths << merged[i] << " ";
+    }
+    f_pointers << std::endl;
+    f_lengths << std::endl;
+
+    if (args.mems)
+    {
+      f_mems << name << std::endl;
+      for (size_t i = 0; i < m; ++i)
+        if ((i == 0) or (merged[i] >= merged[i - 1]))
+          f_mems << "(" << i << "," << merged[i] << ") ";
+      f_mems << std::endl;
+    }
+
+    n_seq++;
+  }
+
+  for (size_t s = 1; s < k; ++s)
+    if (pointers[s]->next(other, p[s]))
+      error("The matching statistics in " + args.shards[s] + " have more reads than in " + args.shards[0]);
+
+  f_pointers.close();
+  f_lengths.close();
+  if (args.mems)
+    f_mems.close();
+
+  std::chrono::high_resolution_clock::time_point t_insert_end = std::chrono::high_resolution_clock::now();
+
+  verbose("Merged the matching statistics of", n_seq, "reads");
+  verbose("Memory peak: ", malloc_count_peak());
+  verbose("Elapsed time (s): ", std::chrono::duration<double, std::ratio<1>>(t_insert_end - t_insert_start).count());
+  return 0;
+}
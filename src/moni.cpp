@@ -0,0 +1,242 @@
+/* moni - Library interface to query and extend reads against a MONI index
+    Copyright (C) 2026 Massimiliano Rossi
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see http://www.gnu.org/licenses/ .
+*/
+/*!
+   \file moni.cpp
+   \brief moni.cpp Library interface to query and extend reads against a MONI index.
+   \author Massimiliano Rossi
+   \date 18/10/2026
+*/
+
+#include <moni.hpp>
+
+#include <common.hpp>
+
+#include <thread>
+#include <stdexcept>
+
+#include <ms_index.hpp>
+#include <kseq_utils.hpp>
+#include <extender_ksw2.hpp>
+
+namespace moni
+{
+
+    // kseq_t pointing to the strings of r, without copies
+    static kseq_t to_kseq(const read &r)
+    {
+        kseq_t seq;
+        memset(&seq, 0, sizeof(kseq_t));
+        seq.name.s = const_cast<char *>(r.name.c_str());
+        seq.name.l = r.name.size();
+        seq.name.m = r.name.size() + 1;
+        seq.seq.s = const_cast<char *>(r.seq.c_str());
+        seq.seq.l = r.seq.size();
+        seq.seq.m = r.seq.size() + 1;
+        if (not r.qual.empty())
+        {
+            seq.qual.s = const_cast<char *>(r.qual.c_str());
+            seq.qual.l = r.qual.size();
+            seq.qual.m = r.qual.size() + 1;
+        }
+        return seq;
+    }
+
+    static alignment to_alignment(const alignment_t &aln)
+    {
+        alignment res;
+        res.aligned = true;
+        res.flag = aln.flag;
+        res.ref_name = aln.ref_name;
+        res.pos = aln.pos;
+        res.mapq = aln.mapq;
+        res.score = aln.score;
+        res.nm = aln.nm;
+        res.md = aln.md;
+        if (not aln.cigar.empty())
+        {
+            res.cigar.clear();
+            for (auto c : aln.cigar)
+                res.cigar += std::to_string(c >> 4) + cigar_ops[c & 0xf];
+        }
+        return res;
+    }
+
+    static void check_file(const std::string &filename)
+    {
+        std::ifstream in(filename);
+        if (not in.is_open())
+            throw std::runtime_error("Cannot open the index file " + filename);
+    }
+
+    // Runs f(i, worker) for i in [0..n-1] on the given number of threads.
+    // Each worker takes the next block of items.
+    template <typename function_t>
+    static void parallel_for(const size_t n, const size_t threads, function_t f)
+    {
+        const size_t n_threads = std::max((size_t)1, std::min(threads, n));
+        if (n_threads <= 1)
+        {
+            for (size_t i = 0; i < n; ++i)
+                f(i, 0);
+            return;
+        }
+
+        std::vector<std::thread> workers;
+        for (size_t t = 0; t < n_threads; ++t)
+            workers.emplace_back([&, t]() {
+                const size_t begin = (n * t) / n_threads;
+                const size_t end = (n * (t + 1)) / n_threads;
+                for (size_t i = begin; i < end; ++i)
+                    f(i, t);
+            });
+        for (auto &w : workers)
+            w.join();
+    }
+
+    template <typename slp_t>
+    class index_impl : public Index
+    {
+    public:
+        using ms_t = ms_pointers<>;
+        using extender_t = extender<slp_t, ms_t>;
+
+        index_impl(const std::string &prefix, const options &opts_) : opts(opts_)
+        {
+            check_file(prefix + ms_t().get_file_extension());
+            check_file(prefix + get_slp_file_extension<slp_t>());
+
+            if (opts.extension)
+            {
+                check_file(prefix + seqidx().get_file_extension());
+
+                typename extender_t::config_t config;
+                config.min_len = opts.min_len;
+                config.ext_len = opts.ext_len;
+                config.local = opts.local;
+                config.cache_blocks = opts.cache_blocks;
+                config.forward_only = false;
+                config.mmap = opts.mmap;
+
+                ext.reset(new extender_t(prefix, config));
+                index = ext.get();
+            }
+            else
+            {
+                plain.reset(new ms_index<slp_t, ms_t>(prefix, opts.mmap));
+                index = plain.get();
+            }
+        }
+
+        size_t length() const override
+        {
+            return index->length();
+        }
+
+        ms_result query_ms(const std::string &seq) override
+        {
+            ms_result res;
+            index->matching_statistics(seq.c_str(), seq.size(), res.pointers, res.lengths);
+            return res;
+        }
+
+        std::vector<mem> query_mems(const std::string &seq) override
+        {
+            ms_result ms = query_ms(seq);
+            std::vector<std::pair<size_t, size_t>> mems;
+            ms_index<slp_t, ms_t>::mems(ms.lengths, mems);
+
+            std::vector<mem> res(mems.size());
+            for (size_t i = 0; i < mems.size(); ++i)
+            {
+                res[i].read_pos = mems[i].first;
+                res[i].length = mems[i].second;
+                res[i].ref_pos = ms.pointers[mems[i].first];
+            }
+            return res;
+        }
+
+        alignment extend(const read &r) override
+        {
+            return extend(r, nullptr);
+        }
+
+        std::vector<ms_result> query_ms(const std::vector<std::string> &seqs) override
+        {
+            std::vector<ms_result> res(seqs.size());
+            parallel_for(seqs.size(), opts.threads, [&](size_t i, size_t) { res[i] = query_ms(seqs[i]); });
+            return res;
+        }
+
+        std::vector<std::vector<mem>> query_mems(const std::vector<std::string> &seqs) override
+        {
+            std::vector<std::vector<mem>> res(seqs.size());
+            parallel_for(seqs.size(), opts.threads, [&](size_t i, size_t) { res[i] = query_mems(seqs[i]); });
+            return res;
+        }
+
+        std::vector<alignment> extend(const std::vector<read> &reads) override
+        {
+            std::vector<alignment> res(reads.size());
+            std::vector<ref_cache> caches(std::max((size_t)1, std::min(opts.threads, reads.size())));
+            parallel_for(reads.size(), opts.threads, [&](size_t i, size_t t) { res[i] = extend(reads[i], &caches[t]); });
+            return res;
+        }
+
+        std::string sam_header() override
+        {
+            if (ext == nullptr)
+                throw std::logic_error("The index was opened without extension");
+            return ext->to_sam();
+        }
+
+    protected:
+        alignment extend(const read &r, ref_cache *cache)
+        {
+            if (ext == nullptr)
+                throw std::logic_error("The index was opened without extension");
+
+            kseq_t seq = to_kseq(r);
+            kseq_t rev;
+            reverse_complement(&rev, &seq);
+
+            alignment_t aln;
+            alignment res;
+            if (ext->align_best(&seq, &rev, aln, cache))
+                res = to_alignment(aln);
+
+            free_kseq_copy(&rev);
+            return res;
+        }
+
+        const options opts;
+
+        std::unique_ptr<extender_t> ext;
+        std::unique_ptr<ms_index<slp_t, ms_t>> plain;
+        ms_index<slp_t, ms_t> *index = nullptr; // Either ext or plain
+    };
+
+    std::unique_ptr<Index> Index::open(const std::string &prefix, const options &opts)
+    {
+        // The shards added with moni add are only queried by the pipeline
+        std::ifstream shards(prefix + ".shards");
+        if (shards.is_open())
+            throw std::runtime_error("The index " + prefix + " has shards, that moni::Index does not support");
+
+        if (opts.slp == grammar::shaped)
+            return std::unique_ptr<Index>(new index_impl<shaped_slp_t>(prefix, opts));
+        else
+            return std::unique_ptr<Index>(new index_impl<plain_slp_t>(prefix, opts));
+    }
+
+} // namespace moni
@@ -42,6 +42,8 @@ struct Args
   bool memo = false;         // print the memory usage
   bool csv = false;          // print stats on stderr in csv format
   bool rle = false;          // outpt RLBWT
+  size_t th = 1;             // number of threads
+  std::string thresholds = "bv"; // thresholds data structure
 };
 
 void parseArgs(int argc, char *const argv[], Args &arg)
@@ -50,14 +52,16 @@ void parseArgs(int argc, char *const argv[], Args &arg)
   extern char *optarg;
   extern int optind;
 
-  std::string usage("usage: " + std::string(argv[0]) + " infile [-s store] [-m memo] [-c csv] [-p patterns] [-f fasta] [-r rle] [-t threads] [-l len]\n\n" +
+  std::string usage("usage: " + std::string(argv[0]) + " infile [-s store] [-m memo] [-c csv] [-p patterns] [-f fasta] [-r rle] [-t threads] [-l len] [-T thresholds]\n\n" +
                     "Computes the pfp data structures of infile, provided that infile.parse, infile.dict, and infile.occ exists.\n" +
                     "   memo: [boolean] - print the data structure memory usage. (def. false)\n" +
                     "    rle: [boolean] - output run length encoded BWT. (def. false)\n" +
-                    "    csv: [boolean] - print the stats in csv form on strerr. (def. false)\n");
+                    "    csv: [boolean] - print the stats in csv form on strerr. (def. false)\n" +
+                    "threads: [integer] - number of threads used to build the index. (def. 1)\n" +
+                    "thresholds: [string] - thresholds data structure: bv, relative, compact, or fused. (def. bv)\n");
 
   std::string sarg;
-  while ((c = getopt(argc, argv, "mcrh")) != -1)
+  while ((c = getopt(argc, argv, "mcrht:T:")) != -1)
   {
     switch (c)
     {
@@ -70,6 +74,13 @@ void parseArgs(int argc, char *const argv[], Args &arg)
     case 'r':
       arg.rle = true;
       break;
+    case 't':
+      sarg.assign(optarg);
+      arg.th = stoi(sarg);
+      break;
+    case 'T':
+      arg.thresholds.assign(optarg);
+      break;
     case 'h':
       error(usage);
     case '?':
@@ -90,20 +101,15 @@ void parseArgs(int argc, char *const argv[], Args &arg)
 
 //********** end argument options ********************
 
-int main(int argc, char *const argv[])
+template <typename ms_t>
+void build(Args &args)
 {
-  using SelSd = SelectSdvec<>;
-  using DagcSd = DirectAccessibleGammaCode<SelSd>;
-
-  Args args;
-  parseArgs(argc, argv, args);
-
   // Building the r-index
 
   verbose("Building the matching statistics index");
   std::chrono::high_resolution_clock::time_point t_insert_start = std::chrono::high_resolution_clock::now();
 
-  ms_pointers<> ms(args.filename, true);
+  ms_t ms(args.filename, true, args.th);
 
   std::chrono::high_resolution_clock::time_point t_insert_end = std::chrono::high_resolution_clock::now();
 
@@ -138,6 +144,23 @@ int main(int argc, char *const argv[])
 
   if (args.csv)
     std::cerr << csv(args.filename.c_str(), time, space, mem_peak) << std::endl;
+}
+
+int main(int argc, char *const argv[])
+{
+  Args args;
+  parseArgs(argc, argv, args);
+
+  if (args.thresholds == "bv")
+    build<ms_pointers<>>(args);
+  else if (args.thresholds == "relative")
+    build<ms_pointers<ri::sparse_sd_vector, ms_rle_string_sd, thr_relative<ms_rle_string_sd>>>(args);
+  else if (args.thresholds == "compact")
+    build<ms_pointers<ri::sparse_sd_vector, ms_rle_string_sd, thr_bv_compact<ms_rle_string_sd>>>(args);
+  else if (args.thresholds == "fused")
+    build<ms_pointers<ri::sparse_sd_vector, ms_rle_string_sd, thr_fused<ms_rle_string_sd>>>(args);
+  else
+    error("Unknown thresholds", args.thresholds);
 
   return 0;
 }
\ No newline at end of file
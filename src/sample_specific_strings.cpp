@@ -28,17 +28,8 @@ extern "C" {
 
 #include <common.hpp>
 
-#include <sdsl/io.hpp>
-
-#include <ms_pointers.hpp>
-
-#include <malloc_count.h>
-
-#include <SelfShapedSlp.hpp>
-#include <DirectAccessibleGammaCode.hpp>
-#include <SelectType.hpp>
-#include <PlainSlp.hpp>
-#include <FixedBitLenCode.hpp>
+#include <kseq_utils.hpp>
+#include <ms_index.hpp>
 
 #include <unordered_map>
 #include <unordered_set>
@@ -48,21 +39,6 @@ extern "C" {
 // for each
 using ss_map_type = std::unordered_map<std::string, std::pair<std::size_t, std::unordered_set<std::size_t>>>;
 
-struct mem_t
-{
-    size_t pos = 0;           // Position in the reference
-    size_t len = 0;           // Length
-    size_t idx = 0;           // Position in the pattern
-    
-    mem_t(size_t p, size_t l, size_t i)
-    {
-        pos = p; // Position in the reference
-        len = l; // Length of the MEM
-        idx = i; // Position in the read
-    }
-    
-};
-
 struct ss_type
 {
     std::string seq;
@@ -71,191 +47,13 @@ struct ss_type
     size_t read_pos;
 };
 
-////////////////////////////////////////////////////////////////////////////////
-/// kseq extra
-////////////////////////////////////////////////////////////////////////////////
-
-static inline size_t ks_tell(kseq_t *seq)
-{
-  return gztell(seq->f->f) - seq->f->end + seq->f->begin;
-}
-
-void copy_kstring_t(kstring_t &l, kstring_t &r)
-{
-  l.l = r.l;
-  l.m = r.m;
-  l.s = (char *)malloc(l.m);
-  for (size_t i = 0; i < r.m; ++i)
-    l.s[i] = r.s[i];
-}
-void copy_kseq_t(kseq_t *l, kseq_t *r)
-{
-  copy_kstring_t(l->name, r->name);
-  copy_kstring_t(l->comment, r->comment);
-  copy_kstring_t(l->seq, r->seq);
-  copy_kstring_t(l->qual, r->qual);
-  l->last_char = r->last_char;
-}
-
-////////////////////////////////////////////////////////////////////////////////
-/// Parallel computation
-////////////////////////////////////////////////////////////////////////////////
-
-// This should be done using buffering.
-size_t next_start_fastq(gzFile fp)
-{
-  int c;
-  // Special case when we arr at the beginning of the file.
-  if ((gztell(fp) == 0) && ((c = gzgetc(fp)) != EOF) && c == '@')
-    return 0;
-
-  // Strart from the previous character
-  gzseek(fp, -1, SEEK_CUR);
-
-  std::vector<std::pair<int, size_t>> window;
-  // Find the first new line
-  for (size_t i = 0; i < 4; ++i)
-  {
-    while (((c = gzgetc(fp)) != EOF) && (c != (int)'\n'))
-    {
-    }
-    if (c == EOF)
-      return gztell(fp);
-    if ((c = gzgetc(fp)) == EOF)
-      return gztell(fp);
-    window.push_back(std::make_pair(c, gztell(fp) - 1));
-  }
-
-  for (size_t i = 0; i < 2; ++i)
-  {
-    if (window[i].first == '@' && window[i + 2].first == '+')
-      return window[i].second;
-    if (window[i].first == '+' && window[i + 2].first == '@')
-      return window[i + 2].second;
-  }
-
-  return gztell(fp);
-}
-
-// test if the file is gzipped
-static inline bool is_gzipped(std::string filename)
-{
-  FILE *fp = fopen(filename.c_str(), "rb");
-  if(fp == NULL) error("Opening file " + filename);
-  int byte1 = 0, byte2 = 0;
-  fread(&byte1, sizeof(char), 1, fp);
-  fread(&byte2, sizeof(char), 1, fp);
-  fclose(fp);
-  return (byte1 == 0x1f && byte2 == 0x8b);
-}
-
-// Return the length of the file
-// Assumes that the file is not compressed
-static inline size_t get_file_size(std::string filename)
-{
-  if (is_gzipped(filename))
-  {
-    std::cerr << "The input is gzipped!" << std::endl;
-    return -1;
-  }
-  FILE *fp = fopen(filename.c_str(), "r");
-  fseek(fp, 0L, SEEK_END);
-  size_t size = ftell(fp);
-  fclose(fp);
-  return size;
-}
-
-std::vector<size_t> split_fastq(std::string filename, size_t n_threads)
-{
-  //Precondition: the file is not gzipped
-  // scan file for start positions and execute threads
-  size_t size = get_file_size(filename);
-
-  gzFile fp = gzopen(filename.c_str(), "r");
-  if (fp == Z_NULL)
-  {
-    throw new std::runtime_error("Cannot open input file " + filename);
-  }
-
-  std::vector<size_t> starts(n_threads + 1);
-  for (int i = 0; i < n_threads + 1; ++i)
-  {
-    size_t start = (size_t)((size * i) / n_threads);
-    gzseek(fp, start, SEEK_SET);
-    starts[i] = next_start_fastq(fp);
-  }
-  gzclose(fp);
-  return starts;
-}
-
-////////////////////////////////////////////////////////////////////////////////
-/// SLP definitions
-////////////////////////////////////////////////////////////////////////////////
-
-using SelSd = SelectSdvec<>;
-using DagcSd = DirectAccessibleGammaCode<SelSd>;
-using Fblc = FixedBitLenCode<>;
-
-using shaped_slp_t = SelfShapedSlp<uint32_t, DagcSd, DagcSd, SelSd>;
-using plain_slp_t = PlainSlp<uint32_t, Fblc, Fblc>;
-
 template <typename slp_t>
-std::string get_slp_file_extension()
-{
-  return std::string(".slp");
-}
-
-template <>
-std::string get_slp_file_extension<shaped_slp_t>()
-{
-  return std::string(".slp");
-}
-
-template <>
-std::string get_slp_file_extension<plain_slp_t>()
-{
-  return std::string(".plain.slp");
-}
-////////////////////////////////////////////////////////////////////////////////
-
-template <typename slp_t>
-class ms_c
+class ms_c : public ms_index<slp_t>
 {
 public:
 
-  ms_c(std::string filename)
+  ms_c(std::string filename) : ms_index<slp_t>(filename)
   {
-    verbose("Loading the matching statistics index");
-    std::chrono::high_resolution_clock::time_point t_insert_start = std::chrono::high_resolution_clock::now();
-
-    std::string filename_ms = filename + ms.get_file_extension();
-
-    ifstream fs_ms(filename_ms);
-    ms.load(fs_ms);
-    fs_ms.close();
-
-    std::chrono::high_resolution_clock::time_point t_insert_end = std::chrono::high_resolution_clock::now();
-
-    verbose("Matching statistics index construction complete");
-    verbose("Memory peak: ", malloc_count_peak());
-    verbose("Elapsed time (s): ", std::chrono::duration<double, std::ratio<1>>(t_insert_end - t_insert_start).count());
-
-    verbose("Loading random access");
-    t_insert_start = std::chrono::high_resolution_clock::now();
-
-    std::string filename_slp = filename + get_slp_file_extension<slp_t>();
-
-    ifstream fs(filename_slp);
-    ra.load(fs);
-    fs.close();
-
-    n = ra.getLen();
-
-    t_insert_end = std::chrono::high_resolution_clock::now();
-
-    verbose("Matching statistics index loading complete");
-    verbose("Memory peak: ", malloc_count_peak());
-    verbose("Elapsed time (s): ", std::chrono::duration<double, std::ratio<1>>(t_insert_end - t_insert_start).count());
   }
 
   // Destructor
@@ -270,50 +68,9 @@ public:
   // stores the lengths of the mathcing statistics.
   void matching_statistics(kseq_t *read, FILE* out, ss_map_type& sample_specifics, FILE* out_ss)
   {
-    size_t mem_pos = 0;
-    size_t mem_len = 0;
-    size_t mem_idx = 0;
-  
     auto pointers = ms.query(read->seq.s, read->seq.l);
-    std::vector<size_t> lengths(pointers.size());
-    size_t l = 0;
-    size_t n_Ns = 0;
-    for (size_t i = 0; i < pointers.size(); ++i)
-    {
-      size_t pos = pointers[i];
-      while ((i + l) < read->seq.l && (pos + l) < n && read->seq.s[i + l] == ra.charAt(pos + l))
-      {
-        if (read->seq.s[i + l] == 'N')
-          n_Ns++;
-        else
-          n_Ns = 0;
-        ++l;
-      }
-    
-      lengths[i] = l;
-      l = (l == 0 ? 0 : (l - 1));
-    
-      // Update MEM
-      if (lengths[i] > mem_len and n_Ns < lengths[i])
-      {
-        mem_len = lengths[i];
-        mem_pos = pointers[i];
-        mem_idx = i;
-      }
-    }
-  
-    mem_t read_longest_mem(mem_pos, mem_len, mem_idx);
-
-    // Original MS computation
-    // for (size_t i = 0; i < pointers.size(); ++i)
-    // {
-    //   size_t pos = pointers[i];
-    //   while ((i + l) < read->seq.l && (pos + l) < n && read->seq.s[i + l] == ra.charAt(pos + l))
-    //     ++l;
-
-    //   lengths[i] = l;
-    //   l = (l == 0 ? 0 : (l - 1));
-    // }
+    std::vector<size_t> lengths;
+    mem_t read_longest_mem = this->longest_mem(read->seq.s, read->seq.l, pointers, lengths);
 
     assert(lengths.size() == pointers.size());
     
@@ -366,30 +123,11 @@ public:
   }
 
 protected:
-  ms_pointers<> ms;
-  slp_t ra;
-  size_t n = 0;
+  using ms_index<slp_t>::ms;
 };
 
 
 
-char complement(char n)
-{
-  switch (n)
-  {
-  case 'A':
-    return 'T';
-  case 'T':
-    return 'A';
-  case 'G':
-    return 'C';
-  case 'C':
-    return 'G';
-  default:
-    return n;
-  }
-}
-
 template <typename ms_t>
 struct mt_param_t
 {
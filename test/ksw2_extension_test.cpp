@@ -0,0 +1,127 @@
+/* ksw2_extension_test - Tests the end of the extensions computed with ksw2
+    Copyright (C) 2026 Massimiliano Rossi
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see http://www.gnu.org/licenses/ .
+*/
+/*!
+   \file ksw2_extension_test.cpp
+   \brief ksw2_extension_test.cpp Tests the end of the extensions computed with ksw2.
+   \author Massimiliano Rossi
+   \date 18/10/2026
+
+   The extensions are computed as in the extender, with KSW_EZ_EXTZ_ONLY and
+   KSW_EZ_RIGHT, and their end must agree with the CIGAR ksw2 backtracked.
+*/
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+
+#include <ksw2_extension.hpp>
+
+static int failures = 0;
+
+#define check(cond, msg)                                               \
+    if (not(cond))                                                     \
+    {                                                                  \
+        std::cerr << __FILE__ << ":" << __LINE__ << ": " << msg << std::endl; \
+        failures++;                                                    \
+    }
+
+struct extension_t
+{
+    ksw_extz_t ez;
+    int32_t score;
+    size_t q_len;
+    size_t t_len;
+    size_t cigar_q; // Query characters consumed by the CIGAR
+    size_t cigar_t; // Target characters consumed by the CIGAR
+};
+
+// Extends query on target with the scoring of the extender.
+static extension_t extend(const std::string &query, const std::string &target, const bool local, const int zdrop, const int end_bonus)
+{
+    const int8_t m = 5, a = 2, b = 4, gapo = 4, gape = 2;
+    int8_t mat[25];
+    for (int i = 0; i < m - 1; ++i)
+    {
+        for (int j = 0; j < m - 1; ++j)
+            mat[i * m + j] = i == j ? a : -b;
+        mat[i * m + m - 1] = 0;
+    }
+    for (int j = 0; j < m; ++j)
+        mat[(m - 1) * m + j] = 0;
+
+    auto nt4 = [](const std::string &s) {
+        std::vector<uint8_t> v(s.size());
+        for (size_t i = 0; i < s.size(); ++i)
+            v[i] = s[i] == 'A' ? 0 : s[i] == 'C' ? 1 : s[i] == 'G' ? 2 : s[i] == 'T' ? 3 : 4;
+        return v;
+    };
+    std::vector<uint8_t> q = nt4(query), t = nt4(target);
+
+    extension_t ext;
+    memset(&ext.ez, 0, sizeof(ksw_extz_t));
+    ksw_reset_extz(&ext.ez);
+    ksw_extz2_sse(0, q.size(), q.data(), t.size(), t.data(), m, mat, gapo, gape, -1, zdrop, end_bonus, KSW_EZ_EXTZ_ONLY | KSW_EZ_RIGHT, &ext.ez);
+    ext.score = ksw2_extension_end(ext.ez, q.size(), local, end_bonus, ext.q_len, ext.t_len);
+
+    ext.cigar_q = ext.cigar_t = 0;
+    for (int i = 0; i < ext.ez.n_cigar; ++i)
+    {
+        const uint32_t op = ext.ez.cigar[i] & 0xf, len = ext.ez.cigar[i] >> 4;
+        if (op == 0 or op == 1)
+            ext.cigar_q += len;
+        if (op == 0 or op == 2)
+            ext.cigar_t += len;
+    }
+    free(ext.ez.cigar);
+    return ext;
+}
+
+int main()
+{
+    const std::string prefix = "ACGTTGCAGGCTAGCTTACGATCGGA";
+    const std::string tail_q(60, 'A');
+    const std::string tail_t(60, 'C');
+
+    // The query diverges from the target after the prefix, and the extension z-drops
+    for (bool local : {true, false})
+    {
+        extension_t ext = extend(prefix + tail_q, prefix + tail_t, local, 20, 5);
+        check(ext.ez.zdropped, "the extension did not z-drop");
+        check(ext.q_len == prefix.size(), "query end " << ext.q_len << " instead of " << prefix.size());
+        check(ext.t_len == prefix.size(), "target end " << ext.t_len << " instead of " << prefix.size());
+        check(ext.score == (int32_t)(2 * prefix.size()), "score " << ext.score << " instead of " << 2 * prefix.size());
+        check(ext.q_len == ext.cigar_q, "query end " << ext.q_len << " and CIGAR " << ext.cigar_q << " differ");
+        check(ext.t_len == ext.cigar_t, "target end " << ext.t_len << " and CIGAR " << ext.cigar_t << " differ");
+    }
+
+    // The query matches the target, and the extension reaches the end of the query
+    for (bool local : {true, false})
+    {
+        extension_t ext = extend(prefix + prefix, prefix + prefix + tail_t, local, 20, 5);
+        check(not ext.ez.zdropped, "the extension z-dropped");
+        check(ext.q_len == 2 * prefix.size(), "query end " << ext.q_len << " instead of " << 2 * prefix.size());
+        check(ext.q_len == ext.cigar_q, "query end " << ext.q_len << " and CIGAR " << ext.cigar_q << " differ");
+        check(ext.t_len == ext.cigar_t, "target end " << ext.t_len << " and CIGAR " << ext.cigar_t << " differ");
+    }
+
+    if (failures > 0)
+    {
+        std::cerr << failures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "All checks passed" << std::endl;
+    return 0;
+}
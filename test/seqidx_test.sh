@@ -0,0 +1,24 @@
+#!/usr/bin/env bash
+# Builds the sequence index of a FASTA file with empty records, with
+# fasta_to_text and with build_seqidx. The empty records are skipped by both,
+# and the two indexes must be the same.
+# usage: seqidx_test.sh fasta_to_text build_seqidx workdir
+set -euo pipefail
+
+fasta_to_text=$1
+build_seqidx=$2
+workdir=$3
+
+rm -rf "${workdir}"
+mkdir -p "${workdir}/text" "${workdir}/seqidx"
+
+printf ">empty1\n>s1\nACGT\n>empty2\n>empty3\n>s2\nGG\nTT\n>empty4\n" > "${workdir}/ref.fa"
+
+"${fasta_to_text}" "${workdir}/ref.fa" -o "${workdir}/ref.fa.txt" -i "${workdir}/text/"
+"${build_seqidx}" "${workdir}/ref.fa" -o "${workdir}/seqidx/"
+
+test "$(cat "${workdir}/ref.fa.txt")" = "ACGTGGTT"
+cmp "${workdir}/text/ref.fa.idx" "${workdir}/seqidx/ref.fa.idx"
+
+rm -rf "${workdir}"
+echo "All checks passed"
@@ -0,0 +1,93 @@
+#!/usr/bin/env bash
+# Builds an index with --shards and queries it with and without --mmap. The
+# matching statistics must be the same with both, and their lengths the ones of
+# the index of the whole reference. Each merged pointer must lie within one
+# shard, and the text at the pointer must match the read. The .idx of the
+# sharded index and the header of its alignments cover the whole reference,
+# with one record for each read.
+# usage: sharded_index_test.sh moni fasta_to_text reference reads workdir
+set -euo pipefail
+
+moni=$1
+fasta_to_text=$2
+reference=$3
+reads=$4
+workdir=$5
+
+rm -rf "${workdir}"
+mkdir -p "${workdir}/text"
+# The build files are written next to the reference
+cp "${reference}" "${workdir}/"
+reference="${workdir}/$(basename "${reference}")"
+
+python3 "${moni}" build -r "${reference}" -o "${workdir}/whole" -f
+python3 "${moni}" build -r "${reference}" -o "${workdir}/sharded" -f --shards 2
+
+python3 "${moni}" ms -i "${workdir}/whole" -p "${reads}" -o "${workdir}/whole"
+python3 "${moni}" ms -i "${workdir}/sharded" -p "${reads}" -o "${workdir}/sharded"
+python3 "${moni}" ms -i "${workdir}/sharded" --mmap -p "${reads}" -o "${workdir}/sharded.mmap"
+
+cmp "${workdir}/sharded.lengths" "${workdir}/whole.lengths"
+cmp "${workdir}/sharded.mmap.lengths" "${workdir}/sharded.lengths"
+cmp "${workdir}/sharded.mmap.pointers" "${workdir}/sharded.pointers"
+
+# The text of the index is the concatenation of the sequences of the reference
+"${fasta_to_text}" "${reference}" -o "${workdir}/text/text" -i "${workdir}/text/"
+cmp "${workdir}/sharded.idx" "${workdir}/text/$(basename "${reference}").idx"
+
+python3 "${moni}" extend -i "${workdir}/whole" -p "${reads}" -o "${workdir}/whole"
+python3 "${moni}" extend -i "${workdir}/sharded" -p "${reads}" -o "${workdir}/sharded"
+
+diff <(grep "^@SQ" "${workdir}/whole.sam") <(grep "^@SQ" "${workdir}/sharded.sam")
+test "$(grep -v "^@" "${workdir}/sharded.sam" | cut -f 1 | sort | uniq | wc -l)" = "$(grep -vc "^@" "${workdir}/sharded.sam")"
+test "$(grep -vc "^@" "${workdir}/sharded.sam")" = "$(grep -vc "^@" "${workdir}/whole.sam")"
+
+python3 - "${workdir}" "${reads}" <<'EOF'
+import gzip, json, os, sys
+
+workdir, reads = sys.argv[1], sys.argv[2]
+
+with open(os.path.join(workdir, "text", "text")) as f:
+    text = f.read()
+
+# Ranges of the texts of the shards in the concatenation, from their .idx
+ranges = []
+with open(os.path.join(workdir, "sharded.shards")) as f:
+    offset = 0
+    for shard in json.load(f)["shards"]:
+        with open(os.path.join(workdir, shard["prefix"] + ".idx"), "rb") as g:
+            length = int.from_bytes(g.read(8), "little")
+        ranges.append((offset, offset + length))
+        offset += length
+assert offset == len(text), "the shards have {} characters, the text {}".format(offset, len(text))
+
+with (gzip.open(reads, "rt") if reads.endswith(".gz") else open(reads)) as f:
+    lines = f.read().splitlines()
+    step = 4 if lines[0].startswith("@") else 2
+    sequences = lines[1::step]
+
+def read_ms(filename):
+    with open(filename) as f:
+        return [[int(x) for x in line.split()] for line in f if not line.startswith(">")]
+
+failures = 0
+for index in ["whole", "sharded"]:
+    pointers = read_ms(os.path.join(workdir, index + ".pointers"))
+    lengths = read_ms(os.path.join(workdir, index + ".lengths"))
+    assert len(pointers) == len(sequences) and len(lengths) == len(sequences)
+    for seq, ptrs, lens in zip(sequences, pointers, lengths):
+        for i, (p, l) in enumerate(zip(ptrs, lens)):
+            if l == 0:
+                continue
+            if text[p:p + l] != seq[i:i + l]:
+                failures += 1
+            if index == "sharded" and not any(b <= p and p + l <= e for b, e in ranges):
+                failures += 1
+
+if failures > 0:
+    print("{} pointers do not match the text or span two shards".format(failures))
+    sys.exit(1)
+EOF
+
+rm -rf "${workdir}"
+echo "All checks passed"
@@ -0,0 +1,34 @@
+#!/usr/bin/env bash
+# Builds the index of the reference with the default bv thresholds and with the
+# given thresholds data structure, and computes the matching statistics and the
+# MEMs of the reads with both. The pointers, the lengths and the MEMs must be
+# the same.
+# usage: thresholds_test.sh moni reference reads workdir thresholds
+set -euo pipefail
+
+moni=$1
+reference=$2
+reads=$3
+workdir=$4
+thresholds=$5
+
+rm -rf "${workdir}"
+mkdir -p "${workdir}"
+# The build files are written next to the reference
+cp "${reference}" "${workdir}/"
+reference="${workdir}/$(basename "${reference}")"
+
+python3 "${moni}" build -r "${reference}" -o "${workdir}/bv" -f
+python3 "${moni}" build -r "${reference}" -o "${workdir}/${thresholds}" -f --thresholds "${thresholds}"
+
+for index in bv "${thresholds}"; do
+    python3 "${moni}" ms -i "${workdir}/${index}" -p "${reads}" -o "${workdir}/${index}"
+    python3 "${moni}" mems -i "${workdir}/${index}" -p "${reads}" -o "${workdir}/${index}"
+done
+
+cmp "${workdir}/${thresholds}.pointers" "${workdir}/bv.pointers"
+cmp "${workdir}/${thresholds}.lengths" "${workdir}/bv.lengths"
+cmp "${workdir}/${thresholds}.mems" "${workdir}/bv.mems"
+
+rm -rf "${workdir}"
+echo "All checks passed"